@@ -9,6 +9,7 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "assert.h"
@@ -18,6 +19,7 @@
 #include "negamax.h"
 #include "situation.h"
 #include "tests.h"
+#include "transposition_table.h"
 #include "utils.h"
 
 namespace wallwars {
@@ -26,32 +28,115 @@ namespace benchmark_internal {
 
 BenchmarkMetrics AverageMetrics(const std::vector<BenchmarkMetrics>& samples) {
   BenchmarkMetrics avg = {};
+  // Times to depth are only averaged for depths completed by every sample.
+  avg.completed_depth = kMaxDepth;
+  for (const auto& sample : samples) {
+    avg.completed_depth = std::min(avg.completed_depth, sample.completed_depth);
+  }
   for (const auto& sample : samples) {
     avg.wall_clock_time_ms += sample.wall_clock_time_ms;
     avg.graph_primitives += sample.graph_primitives;
+    avg.nodes += sample.nodes;
+    avg.helper_nodes += sample.helper_nodes;
+    avg.split_points += sample.split_points;
+    avg.pvs_null_window_searches += sample.pvs_null_window_searches;
+    avg.killer_searches += sample.killer_searches;
+    avg.killer_cutoffs += sample.killer_cutoffs;
+    avg.killer_legality_checks += sample.killer_legality_checks;
+    avg.killer_legality_traversals += sample.killer_legality_traversals;
+    avg.countermove_searches += sample.countermove_searches;
+    avg.countermove_cutoffs += sample.countermove_cutoffs;
+    avg.beta_cutoffs += sample.beta_cutoffs;
+    avg.split_helper_moves += sample.split_helper_moves;
+    avg.distance_cache_hits += sample.distance_cache_hits;
+    avg.distance_cache_misses += sample.distance_cache_misses;
+    avg.structure_cache_hits += sample.structure_cache_hits;
+    avg.structure_cache_misses += sample.structure_cache_misses;
+    avg.move_list_cache_hits += sample.move_list_cache_hits;
+    avg.move_list_cache_misses += sample.move_list_cache_misses;
+    avg.tt_probes += sample.tt_probes;
+    avg.tt_hits += sample.tt_hits;
+    avg.tt_hot_hits += sample.tt_hot_hits;
+    avg.tt_verified_hits += sample.tt_verified_hits;
+    avg.tt_verified_collisions += sample.tt_verified_collisions;
+    avg.tt_stats.sampled_entries += sample.tt_stats.sampled_entries;
+    avg.tt_stats.hashfull_permille += sample.tt_stats.hashfull_permille;
+    avg.tt_stats.stale_permille += sample.tt_stats.stale_permille;
     for (int depth = 0; depth <= kMaxDepth; ++depth) {
       for (int exit_type = 0; exit_type < kNumExitTypes; ++exit_type) {
         avg.num_exits[depth][exit_type] += sample.num_exits[depth][exit_type];
       }
       avg.tt_improvement_reads[depth] += sample.tt_improvement_reads[depth];
       avg.tt_useless_reads[depth] += sample.tt_useless_reads[depth];
+      avg.tt_decided_reads[depth] += sample.tt_decided_reads[depth];
+      avg.tt_collision_reads[depth] += sample.tt_collision_reads[depth];
       avg.tt_add_writes[depth] += sample.tt_add_writes[depth];
       avg.tt_replace_writes[depth] += sample.tt_replace_writes[depth];
+      avg.tt_evictions[depth] += sample.tt_evictions[depth];
       avg.generated_children[depth] += sample.generated_children[depth];
+      avg.time_to_depth_ms[depth] += sample.time_to_depth_ms[depth];
+      avg.nodes_to_depth[depth] += sample.nodes_to_depth[depth];
+      avg.pvs_re_searches[depth] += sample.pvs_re_searches[depth];
+      avg.lmr_searches[depth] += sample.lmr_searches[depth];
+      avg.lmr_re_searches[depth] += sample.lmr_re_searches[depth];
+      avg.aspiration_fail_lows[depth] += sample.aspiration_fail_lows[depth];
+      avg.aspiration_fail_highs[depth] += sample.aspiration_fail_highs[depth];
+      avg.aspiration_re_search_ms[depth] +=
+          sample.aspiration_re_search_ms[depth];
+      avg.tt_stats.depth_permille[depth] +=
+          sample.tt_stats.depth_permille[depth];
     }
   }
   int n = samples.size();
   avg.wall_clock_time_ms /= n;
   avg.graph_primitives /= n;
+  avg.nodes /= n;
+  avg.helper_nodes /= n;
+  avg.split_points /= n;
+  avg.pvs_null_window_searches /= n;
+  avg.killer_searches /= n;
+  avg.killer_cutoffs /= n;
+  avg.killer_legality_checks /= n;
+  avg.killer_legality_traversals /= n;
+  avg.countermove_searches /= n;
+  avg.countermove_cutoffs /= n;
+  avg.beta_cutoffs /= n;
+  avg.split_helper_moves /= n;
+  avg.distance_cache_hits /= n;
+  avg.distance_cache_misses /= n;
+  avg.structure_cache_hits /= n;
+  avg.structure_cache_misses /= n;
+  avg.move_list_cache_hits /= n;
+  avg.move_list_cache_misses /= n;
+  avg.tt_probes /= n;
+  avg.tt_hits /= n;
+  avg.tt_hot_hits /= n;
+  avg.tt_verified_hits /= n;
+  avg.tt_verified_collisions /= n;
+  avg.tt_stats.sampled_entries /= n;
+  avg.tt_stats.hashfull_permille /= n;
+  avg.tt_stats.stale_permille /= n;
   for (int depth = 0; depth <= kMaxDepth; ++depth) {
     for (int exit_type = 0; exit_type < kNumExitTypes; ++exit_type) {
       avg.num_exits[depth][exit_type] /= n;
     }
     avg.tt_improvement_reads[depth] /= n;
     avg.tt_useless_reads[depth] /= n;
+    avg.tt_decided_reads[depth] /= n;
+    avg.tt_collision_reads[depth] /= n;
     avg.tt_add_writes[depth] /= n;
     avg.tt_replace_writes[depth] /= n;
+    avg.tt_evictions[depth] /= n;
     avg.generated_children[depth] /= n;
+    avg.time_to_depth_ms[depth] /= n;
+    avg.nodes_to_depth[depth] /= n;
+    avg.pvs_re_searches[depth] /= n;
+    avg.lmr_searches[depth] /= n;
+    avg.lmr_re_searches[depth] /= n;
+    avg.aspiration_fail_lows[depth] /= n;
+    avg.aspiration_fail_highs[depth] /= n;
+    avg.aspiration_re_search_ms[depth] /= n;
+    avg.tt_stats.depth_permille[depth] /= n;
   }
   return avg;
 }
@@ -59,16 +144,42 @@ BenchmarkMetrics AverageMetrics(const std::vector<BenchmarkMetrics>& samples) {
 // Prints relevant settings about the environment (program constants, program
 // flags, compiler, OS, hardware, etc.) that provide context about the
 // benchmark results.
-std::string BenchmarkSettings(std::string description, std::string timestamp) {
+std::string BenchmarkSettings(std::string description, std::string timestamp,
+                              const NegamaxOptions& options) {
   std::ostringstream sout;
   sout << "Description: " << description << "\n"
        << "Time: " << timestamp << "\n\n"
        << "Num benchmark samples: " << kBenchmarkNumSamples << "\n"
        << "Negamax search time (ms): " << kBenchmarksearchTimeMillis << '\n'
        << "Negamax max depth: " << kMaxDepth << '\n'
-       << "TT size (MB): " << kTranspositionTableMB << '\n'
+       << "TT size (MB): " << options.tt_mb << '\n'
+       << "Num entries in TT: " << NumTTEntries(options.tt_mb) << '\n'
+       << "TT hit verification: " << kTTVerifyHits << '\n'
+       << "TT prefetch distance: " << options.tt_prefetch_distance << '\n'
+       << "Mirror symmetry in TT: " << options.mirror_symmetry << '\n'
+       << "Search threads: " << options.num_threads
+       << (options.split_points ? " (split points)" : " (Lazy SMP)") << '\n'
+       << "Principal Variation Search: " << options.pvs << '\n'
+       << "Aspiration window: " << options.aspiration_window << " (growth: x"
+       << kAspirationWindowGrowth << ")\n"
+       << "Killer moves per ply: " << options.num_killers << '\n'
+       << "History weight: " << options.history_weight << '\n'
+       << "Countermoves: " << options.countermoves << '\n'
+       << "Late move reductions by depth:";
+  if (options.lmr_reductions.empty()) sout << " none";
+  for (int reduction : options.lmr_reductions) sout << ' ' << reduction;
+  sout << " (from move " << options.lmr_min_moves << ", scores below "
+       << options.lmr_score_threshold << ")\n"
+       << "Two-tier TT: " << options.two_tier_tt;
+  if (options.two_tier_tt) {
+    sout << " (hot table: " << kHotTTMB << " MB for depths <= "
+         << kHotTTMaxDepth << ")";
+  }
+  sout << '\n'
+       << "TT file: " << (options.tt_file.empty() ? "none" : options.tt_file)
+       << '\n'
        << "Sizes (bytes): Move: " << sizeof(Move) << " int: " << sizeof(int)
-       << '\n';
+       << " TTEntry: " << sizeof(TTEntry) << '\n';
   return sout.str();
 }
 
@@ -79,10 +190,8 @@ std::string DimensionsSettings() {
   std::ostringstream sout;
   sout << "\nBoard dimensions: " << R << " x " << C << '\n'
        << "Branching factor (upper bound): " << MaxNumLegalMoves(R, C) << '\n'
-       << "Num entries in TT: " << NumTTEntries<R, C>() << '\n'
        << "Sizes (bytes): Graph: " << sizeof(Graph<R, C>)
-       << " Situation: " << sizeof(Situation<R, C>)
-       << " TTEntry: " << sizeof(TTEntry<R, C>) << '\n';
+       << " Situation: " << sizeof(Situation<R, C>) << '\n';
   return sout.str();
 }
 
@@ -106,7 +215,41 @@ const std::vector<std::string> kCsvColumns = {"situation",
                                               "tt_no_writes",
                                               "generated_children",
                                               "visited_children",
-                                              "pruned_children"};
+                                              "pruned_children",
+                                              "tt_collision_reads",
+                                              "tt_evictions",
+                                              "nodes",
+                                              "nodes_per_second",
+                                              "distance_cache_hits",
+                                              "distance_cache_misses",
+                                              "tt_hashfull_permille",
+                                              "tt_stale_permille",
+                                              "tt_verified_collisions",
+                                              "tt_probes",
+                                              "tt_hits",
+                                              "tt_hot_hits",
+                                              "tt_decided_reads",
+                                              "move_list_cache_hits",
+                                              "move_list_cache_misses",
+                                              "structure_cache_hits",
+                                              "structure_cache_misses",
+                                              "helper_nodes",
+                                              "completed_depth",
+                                              "split_points",
+                                              "split_helper_moves",
+                                              "pvs_null_window_searches",
+                                              "pvs_re_searches",
+                                              "aspiration_re_searches",
+                                              "aspiration_re_search_ms",
+                                              "killer_searches",
+                                              "killer_cutoffs",
+                                              "killer_legality_checks",
+                                              "killer_legality_traversals",
+                                              "countermove_searches",
+                                              "countermove_cutoffs",
+                                              "beta_cutoffs",
+                                              "lmr_searches",
+                                              "lmr_re_searches"};
 
 std::string CsvHeaderRow() {
   std::ostringstream sout;
@@ -127,7 +270,23 @@ std::string CsvRow(const std::string& sit_name, const std::string& move,
   for (int i = 0; i < kNumTTReadTypes; ++i) sout << "," << m.TTReadsOfType(i);
   for (int i = 0; i < kNumTTWriteTypes; ++i) sout << "," << m.TTWritesOfType(i);
   sout << "," << m.TotalGeneratedChildren() << "," << m.TotalVisitedChildren()
-       << "," << m.TotalPrunedChildren() << std::endl;
+       << "," << m.TotalPrunedChildren() << "," << m.TotalTTCollisionReads()
+       << "," << m.TotalTTEvictions() << "," << m.nodes << ","
+       << m.NodesPerSecond() << "," << m.distance_cache_hits << ","
+       << m.distance_cache_misses << "," << m.tt_stats.hashfull_permille << ","
+       << m.tt_stats.stale_permille << "," << m.tt_verified_collisions << ","
+       << m.tt_probes << "," << m.tt_hits << "," << m.tt_hot_hits << ","
+       << m.TotalTTDecidedReads() << "," << m.move_list_cache_hits << ","
+       << m.move_list_cache_misses << "," << m.structure_cache_hits << ","
+       << m.structure_cache_misses << "," << m.helper_nodes << ","
+       << m.completed_depth << "," << m.split_points << ","
+       << m.split_helper_moves << "," << m.pvs_null_window_searches << ","
+       << m.TotalPVSReSearches() << "," << m.TotalAspirationReSearches() << ","
+       << m.TotalAspirationReSearchMillis() << "," << m.killer_searches << ","
+       << m.killer_cutoffs << "," << m.killer_legality_checks << ","
+       << m.killer_legality_traversals << "," << m.countermove_searches << ","
+       << m.countermove_cutoffs << "," << m.beta_cutoffs << ","
+       << m.TotalLMRSearches() << "," << m.TotalLMRReSearches() << std::endl;
   return sout.str();
 }
 
@@ -289,6 +448,123 @@ std::string TTReadWriteTables(std::map<std::string, std::string> prev_csv,
   table1.Print(sout, 2);
   sout << "\nTransposition table reads and writes (%):\n";
   table2.Print(sout, 2);
+  sout << "\nDetected TT collisions: " << m.TotalTTCollisionReads() << " ("
+       << ToStringWithPrecision(
+              Percentage(m.TotalTTCollisionReads(), m.TotalTTProbes()), 4)
+       << "% of probes)\n";
+  return sout.str();
+}
+
+// One row per depth of the evicted entries, and a row with the sum.
+std::string TTEvictionTable(const BenchmarkMetrics& m) {
+  StrTable table;
+  table.AddToNewRow({"Depth", "Evictions", "%"});
+  long long total = m.TotalTTEvictions();
+  for (int depth = kMaxDepth; depth >= 0; --depth) {
+    if (m.tt_evictions[depth] == 0) continue;
+    table.AddToNewRow(depth);
+    table.AddToLastRow(m.tt_evictions[depth]);
+    table.AddToLastRow(Percentage(m.tt_evictions[depth], total), 1);
+  }
+  table.AddHorizontalLineRow();
+  table.AddToNewRow("Sum");
+  table.AddToLastRow(total);
+  table.AddToLastRow("100");
+  std::ostringstream sout;
+  sout << "Transposition table evictions by depth of the evicted entry:\n";
+  table.Print(sout, 2);
+  return sout.str();
+}
+
+// Does `kBenchmarkTTOpsPerThread` operations in each of `num_threads` threads
+// sharing `TT`. An operation probes a random situation and then stores it, like
+// a node of the search. The situations are drawn from a pool twice as large as
+// the TT, so threads contend for the same buckets. Returns the throughput in
+// millions of operations per second. `corrupt_hits` is set to the number of
+// probes that returned an entry that was never stored for that hash, which the
+// lockless encoding of the entries should prevent.
+double TTThroughput(TranspositionTable<10, 12>& TT, int num_threads,
+                    long long& corrupt_hits) {
+  const uint64_t pool_size = 2 * TT.NumEntries();
+  // The eval and depth stored for a hash are derived from it, so that probes
+  // can check them.
+  auto eval_of = [](uint64_t hash) { return static_cast<int16_t>(hash >> 8); };
+  auto depth_of = [](uint64_t hash) { return static_cast<int8_t>(hash & 63); };
+  std::vector<long long> thread_corrupt_hits(num_threads, 0);
+  auto worker = [&](int thread_id) {
+    uint64_t rng_state = thread_id + 1;
+    long long corrupt = 0;
+    for (long long i = 0; i < kBenchmarkTTOpsPerThread; ++i) {
+      uint64_t hash_state = SplitMix64(rng_state) % pool_size;
+      uint64_t hash = SplitMix64(hash_state);
+      TTEntry entry;
+      if (TT.Probe(hash, entry) &&
+          (entry.eval != eval_of(hash) || entry.depth != depth_of(hash))) {
+        ++corrupt;
+      }
+      TT.Store(hash, kExactFlag, depth_of(hash), eval_of(hash), NullMove());
+    }
+    thread_corrupt_hits[thread_id] = corrupt;
+  };
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) threads.emplace_back(worker, i);
+  for (std::thread& thread : threads) thread.join();
+  auto stop = std::chrono::high_resolution_clock::now();
+  corrupt_hits = 0;
+  for (long long corrupt : thread_corrupt_hits) corrupt_hits += corrupt;
+  double seconds = std::chrono::duration<double>(stop - start).count();
+  return num_threads * kBenchmarkTTOpsPerThread / seconds / 1e6;
+}
+
+// One row per number of threads sharing the TT.
+std::string TTThroughputTable(const NegamaxOptions& options) {
+  StrTable table;
+  table.AddToNewRow({"Threads", "Mops/s", "Speedup", "Corrupt hits"});
+  TranspositionTable<10, 12> TT(options.tt_mb);
+  long long corrupt_hits;
+  // Untimed run so that the memory of the table is already mapped.
+  TTThroughput(TT, 1, corrupt_hits);
+  double single_thread_mops = 0;
+  for (int num_threads : {1, 2, 4, 8}) {
+    double mops = TTThroughput(TT, num_threads, corrupt_hits);
+    if (num_threads == 1) single_thread_mops = mops;
+    table.AddToNewRow(num_threads);
+    table.AddToLastRow(mops, 2);
+    table.AddToLastRow(mops / single_thread_mops, 2);
+    table.AddToLastRow(corrupt_hits);
+  }
+  std::ostringstream sout;
+  sout << "Shared transposition table throughput (" << kBenchmarkTTOpsPerThread
+       << " probe+store operations per thread, "
+       << std::thread::hardware_concurrency() << " hardware threads):\n";
+  table.Print(sout, 2);
+  return sout.str();
+}
+
+// The sampled contents of the TT at the end of the search: one row per depth of
+// the stored entries, and the collisions found by `kTTVerifyHits`, if enabled.
+std::string TTContentsTable(const BenchmarkMetrics& m) {
+  const TTStats& stats = m.tt_stats;
+  StrTable table;
+  table.AddToNewRow(std::vector<std::string>{"Depth", "Permille"});
+  for (int depth = kMaxDepth; depth >= 0; --depth) {
+    if (stats.depth_permille[depth] == 0) continue;
+    table.AddToNewRow(depth);
+    table.AddToLastRow(stats.depth_permille[depth]);
+  }
+  table.AddHorizontalLineRow();
+  table.AddToNewRow("Sum");
+  table.AddToLastRow(stats.hashfull_permille);
+  std::ostringstream sout;
+  sout << "Transposition table contents (sample of " << stats.sampled_entries
+       << " entries): " << stats.hashfull_permille << " permille full, "
+       << stats.stale_permille << " permille from earlier searches\n";
+  table.Print(sout, 2);
+  if (kTTVerifyHits) {
+    sout << "Verified collisions: " << m.tt_verified_collisions << " of "
+         << m.tt_verified_hits << " checked hits\n";
+  }
   return sout.str();
 }
 
@@ -362,7 +638,8 @@ std::string ComparisonTable(
     std::map<std::string, std::map<std::string, std::string>> curr_csv_map) {
   StrTable table;
   table.AddToNewRow({"Situation", "|", "move", "", "|", "time", "", "|",
-                     "graph_p", "", "|", "visited", "", "|", "pruned", ""});
+                     "graph_p", "", "|", "visited", "", "|", "pruned", "",
+                     "|", "nodes/s", ""});
 
   std::vector<std::string> sits =
       ColumnUnion(prev_csv_table, curr_csv_table, 0);
@@ -375,7 +652,8 @@ std::string ComparisonTable(
          prev_map["runtime_ms"], curr_map["runtime_ms"], "|",
          prev_map["graph_primitives"], curr_map["graph_primitives"], "|",
          prev_map["visited_children"], curr_map["visited_children"], "|",
-         prev_map["pruned_children"], curr_map["pruned_children"]});
+         prev_map["pruned_children"], curr_map["pruned_children"], "|",
+         prev_map["nodes_per_second"], curr_map["nodes_per_second"]});
     if (prev_map["move"] != curr_map["move"]) diff_move = true;
   }
 
@@ -388,19 +666,140 @@ std::string ComparisonTable(
   return sout.str();
 }
 
+// One row per ID iteration completed by the main thread, with the nodes and
+// time spent until its end, its duration, and the searches repeated because
+// the eval was outside of the aspiration window. If `full_window` is not null,
+// it is a search of the same situation without aspiration windows, and the
+// last column is the time to depth saved compared to it.
+std::string IterationTable(const BenchmarkMetrics& m,
+                           const BenchmarkMetrics* full_window) {
+  StrTable table;
+  table.AddToNewRow({"Depth", "Nodes to depth", "Time to depth", "Iteration",
+                     "Fail-lows", "Fail-highs", "Re-search ms", "%"});
+  if (full_window != nullptr) table.AddToLastRow("Saved ms");
+  for (int depth = m.completed_depth; depth >= 1; --depth) {
+    const long long iteration_ms =
+        m.time_to_depth_ms[depth] - m.time_to_depth_ms[depth - 1];
+    table.AddToNewRow(depth);
+    table.AddToLastRow(m.nodes_to_depth[depth]);
+    table.AddToLastRow(m.time_to_depth_ms[depth]);
+    table.AddToLastRow(iteration_ms);
+    table.AddToLastRow(m.aspiration_fail_lows[depth]);
+    table.AddToLastRow(m.aspiration_fail_highs[depth]);
+    table.AddToLastRow(m.aspiration_re_search_ms[depth]);
+    table.AddToLastRow(Percentage(m.aspiration_re_search_ms[depth],
+                                  std::max(1LL, iteration_ms)),
+                       1);
+    if (full_window == nullptr) continue;
+    if (depth > full_window->completed_depth) {
+      table.AddToLastRow("-");
+    } else {
+      table.AddToLastRow(full_window->time_to_depth_ms[depth] -
+                         m.time_to_depth_ms[depth]);
+    }
+  }
+  std::ostringstream sout;
+  sout << "Iterative deepening (ms):\n";
+  table.Print(sout, 2);
+  return sout.str();
+}
+
 // `benchmark_metrics` is a global variable. This function assumes that it has
-// been set as a result of the AI finding a move in a situation.
+// been set as a result of the AI finding a move in a situation. `full_window`
+// is passed to `IterationTable`.
 std::string BenchmarkMetricsReport(
     const std::map<std::string, std::string>& prev_csv,
-    const BenchmarkMetrics& m) {
+    const BenchmarkMetrics& m, const BenchmarkMetrics* full_window = nullptr) {
   std::ostringstream sout;
   long long ms = m.wall_clock_time_ms;
   long long gp = m.graph_primitives;
   sout << "Duration (ms): " << ms << '\n' << "Graph primitives: " << gp;
   if (ms > 0) sout << " (" << gp / ms << "/ms)";
+  sout << "\nNodes: " << m.nodes << " (" << m.NodesPerSecond() << "/s)";
+  if (m.helper_nodes > 0) sout << ", helper threads: " << m.helper_nodes;
+  if (m.split_points > 0) {
+    sout << "\nSplit points: " << m.split_points << " ("
+         << m.split_helper_moves << " moves searched by helper threads)";
+  }
+  long long distance_cache_lookups =
+      m.distance_cache_hits + m.distance_cache_misses;
+  sout << "\nDistance cache hits: " << m.distance_cache_hits << " of "
+       << distance_cache_lookups << " lookups";
+  if (distance_cache_lookups > 0) {
+    sout << " ("
+         << ToStringWithPrecision(
+                Percentage(m.distance_cache_hits, distance_cache_lookups), 3)
+         << "%)";
+  }
+  sout << "\nStructure cache hits: " << m.structure_cache_hits << " of "
+       << m.structure_cache_hits + m.structure_cache_misses << " lookups";
+  sout << "\nMove list cache hits: " << m.move_list_cache_hits << " of "
+       << m.move_list_cache_hits + m.move_list_cache_misses << " lookups";
+  sout << "\nTT hits: " << m.tt_hits << " of " << m.tt_probes << " probes";
+  if (m.tt_probes > 0) {
+    sout << " ("
+         << ToStringWithPrecision(Percentage(m.tt_hits, m.tt_probes), 3)
+         << "%)";
+  }
+  if (m.tt_hot_hits > 0) sout << ", " << m.tt_hot_hits << " in the hot table";
+  if (m.pvs_null_window_searches > 0) {
+    sout << "\nPVS re-searches: " << m.TotalPVSReSearches() << " of "
+         << m.pvs_null_window_searches << " null-window searches ("
+         << ToStringWithPrecision(Percentage(m.TotalPVSReSearches(),
+                                             m.pvs_null_window_searches),
+                                  3)
+         << "%), by depth:";
+    for (int depth = kMaxDepth; depth >= 1; --depth) {
+      if (m.pvs_re_searches[depth] == 0) continue;
+      sout << " " << depth << ":" << m.pvs_re_searches[depth];
+    }
+  }
+  if (m.killer_searches > 0) {
+    sout << "\nKiller move cutoffs: " << m.killer_cutoffs << " of "
+         << m.killer_searches << " searches ("
+         << ToStringWithPrecision(
+                Percentage(m.killer_cutoffs, m.killer_searches), 3)
+         << "%)";
+  }
+  if (m.killer_legality_checks > 0) {
+    sout << "\nKiller legality checks with graph traversals: "
+         << m.killer_legality_traversals << " of " << m.killer_legality_checks
+         << " ("
+         << ToStringWithPrecision(Percentage(m.killer_legality_traversals,
+                                             m.killer_legality_checks),
+                                  3)
+         << "%)";
+  }
+  if (m.countermove_searches > 0) {
+    sout << "\nCountermove cutoffs: " << m.countermove_cutoffs << " of "
+         << m.countermove_searches << " searches ("
+         << ToStringWithPrecision(
+                Percentage(m.countermove_cutoffs, m.countermove_searches), 3)
+         << "%), "
+         << ToStringWithPrecision(
+                Percentage(m.countermove_cutoffs, m.beta_cutoffs), 3)
+         << "% of " << m.beta_cutoffs << " beta cutoffs";
+  }
+  if (m.TotalLMRSearches() > 0) {
+    sout << "\nLMR re-searches: " << m.TotalLMRReSearches() << " of "
+         << m.TotalLMRSearches() << " reduced searches ("
+         << ToStringWithPrecision(
+                Percentage(m.TotalLMRReSearches(), m.TotalLMRSearches()), 3)
+         << "%), by depth:";
+    for (int depth = kMaxDepth; depth >= 1; --depth) {
+      if (m.lmr_searches[depth] == 0) continue;
+      sout << " " << depth << ":" << m.lmr_re_searches[depth] << "/"
+           << m.lmr_searches[depth];
+    }
+  }
+  sout << "\nTT reads of decided entries shallower than the node: "
+       << m.TotalTTDecidedReads();
   sout << "\n\n"
+       << IterationTable(m, full_window) << '\n'
        << ExitTypeTable(prev_csv, m) << '\n'
        << TTReadWriteTables(prev_csv, m) << '\n'
+       << TTEvictionTable(m) << '\n'
+       << TTContentsTable(m) << '\n'
        << ChildGenerationTable(prev_csv, m);
   return sout.str();
 }
@@ -468,10 +867,110 @@ std::pair<Move, BenchmarkMetrics> GetMoveWithMetrics(Negamax<R, C>& negamax,
   global_metrics.wall_clock_time_ms =
       std::chrono::duration_cast<std::chrono::milliseconds>(stop - start)
           .count();
+  global_metrics.tt_stats = negamax.TTStatistics();
   return {move, global_metrics};
 }
 
+// Searches `sit` in parallel (see `NegamaxOptions::num_threads`) with 1, 2,
+// 4, ... threads, up to `options.num_threads`, with one row per number of
+// threads. Since the searches have a fixed duration, the speedup and the node
+// overhead are measured at the deepest depth completed by every search.
+template <int R, int C>
+std::string ParallelSearchTable(const NegamaxOptions& options,
+                                const Situation<R, C>& sit) {
+  std::vector<int> thread_counts;
+  for (int num_threads = 1; num_threads < options.num_threads;
+       num_threads *= 2) {
+    thread_counts.push_back(num_threads);
+  }
+  thread_counts.push_back(options.num_threads);
+  std::vector<BenchmarkMetrics> runs;
+  int common_depth = kMaxDepth;
+  for (int num_threads : thread_counts) {
+    NegamaxOptions run_options = options;
+    run_options.num_threads = num_threads;
+    Negamax<R, C> negamaxer(run_options);
+    runs.push_back(GetMoveWithMetrics<R, C>(negamaxer, sit).second);
+    common_depth = std::min(common_depth, runs.back().completed_depth);
+  }
+  const std::string common_depth_str = std::to_string(common_depth);
+  StrTable table;
+  table.AddToNewRow({"Threads", "Depth", "Nodes", "Helper nodes",
+                     "Nodes to depth " + common_depth_str, "Overhead",
+                     "Time to depth " + common_depth_str, "Speedup"});
+  for (size_t i = 0; i < runs.size(); ++i) {
+    const BenchmarkMetrics& m = runs[i];
+    table.AddToNewRow(thread_counts[i]);
+    table.AddToLastRow(m.completed_depth);
+    table.AddToLastRow(m.nodes);
+    table.AddToLastRow(m.helper_nodes);
+    const long long nodes = m.nodes_to_depth[common_depth];
+    table.AddToLastRow(nodes);
+    table.AddToLastRow(
+        static_cast<double>(nodes) /
+            std::max(1LL, runs[0].nodes_to_depth[common_depth]),
+        2);
+    const long long millis = m.time_to_depth_ms[common_depth];
+    table.AddToLastRow(millis);
+    table.AddToLastRow(
+        static_cast<double>(runs[0].time_to_depth_ms[common_depth]) /
+            std::max(1LL, millis),
+        2);
+  }
+  std::ostringstream sout;
+  sout << (options.split_points ? "Split points" : "Lazy SMP")
+       << " on an empty " << R << "x" << C << " board ("
+       << std::thread::hardware_concurrency() << " hardware threads):\n";
+  table.Print(sout, 2);
+  return sout.str();
+}
+
+// Searches `sit` with `options.two_tier_tt` off and on (see
+// `NegamaxOptions::two_tier_tt`), with one row for each. Like in
+// `ParallelSearchTable`, the searches have a fixed duration, so nodes and
+// times are compared at the deepest depth completed by both.
+template <int R, int C>
+std::string TwoTierTTTable(const NegamaxOptions& options,
+                           const Situation<R, C>& sit) {
+  std::vector<BenchmarkMetrics> runs;
+  int common_depth = kMaxDepth;
+  for (bool two_tier_tt : {false, true}) {
+    NegamaxOptions run_options = options;
+    run_options.two_tier_tt = two_tier_tt;
+    Negamax<R, C> negamaxer(run_options);
+    runs.push_back(GetMoveWithMetrics<R, C>(negamaxer, sit).second);
+    common_depth = std::min(common_depth, runs.back().completed_depth);
+  }
+  const std::string common_depth_str = std::to_string(common_depth);
+  StrTable table;
+  table.AddToNewRow({"Two-tier TT", "Depth", "Nodes", "TT hits", "Hot hits",
+                     "Evictions", "Nodes to depth " + common_depth_str,
+                     "Time to depth " + common_depth_str, "Speedup"});
+  for (size_t i = 0; i < runs.size(); ++i) {
+    const BenchmarkMetrics& m = runs[i];
+    table.AddToNewRow(std::string(i == 0 ? "Off" : "On"));
+    table.AddToLastRow(m.completed_depth);
+    table.AddToLastRow(m.nodes);
+    table.AddToLastRow(m.tt_hits);
+    table.AddToLastRow(m.tt_hot_hits);
+    table.AddToLastRow(m.TotalTTEvictions());
+    table.AddToLastRow(m.nodes_to_depth[common_depth]);
+    const long long millis = m.time_to_depth_ms[common_depth];
+    table.AddToLastRow(millis);
+    table.AddToLastRow(
+        static_cast<double>(runs[0].time_to_depth_ms[common_depth]) /
+            std::max(1LL, millis),
+        2);
+  }
+  std::ostringstream sout;
+  sout << "Two-tier TT on an empty " << R << "x" << C << " board ("
+       << options.tt_mb << " MB TT):\n";
+  table.Print(sout, 2);
+  return sout.str();
+}
+
 struct BenchmarkContext {
+  const NegamaxOptions& options;
   std::ostream& report_out;
   std::ostream& csv_out;
   std::map<std::string, std::map<std::string, std::string>>& prev_csv_map;
@@ -493,7 +992,7 @@ void BenchmarkSituation(BenchmarkContext& context,
   std::string first_move = "";
   StreamAndStdOut(context.report_out, "Situation: " + input.sit_name);
   for (int i = 0; i < kBenchmarkNumSamples; ++i) {
-    Negamax<R, C> negamaxer;
+    Negamax<R, C> negamaxer(context.options);
     auto move_metrics = GetMoveWithMetrics<R, C>(negamaxer, sit);
     std::string move = sit.MoveToStandardNotation(move_metrics.first);
     if (i == 0) first_move = move;
@@ -507,8 +1006,19 @@ void BenchmarkSituation(BenchmarkContext& context,
     samples.push_back(move_metrics.second);
   }
   BenchmarkMetrics avg_metrics = AverageMetrics(samples);
-  std::string report =
-      BenchmarkMetricsReport(context.prev_csv_map[input.sit_name], avg_metrics);
+  // With aspiration windows, one more search without them measures the time
+  // that they save at each depth.
+  BenchmarkMetrics full_window_metrics;
+  const BenchmarkMetrics* full_window = nullptr;
+  if (context.options.aspiration_window > 0) {
+    NegamaxOptions full_window_options = context.options;
+    full_window_options.aspiration_window = 0;
+    Negamax<R, C> negamaxer(full_window_options);
+    full_window_metrics = GetMoveWithMetrics<R, C>(negamaxer, sit).second;
+    full_window = &full_window_metrics;
+  }
+  std::string report = BenchmarkMetricsReport(
+      context.prev_csv_map[input.sit_name], avg_metrics, full_window);
   StreamAndStdOut(context.report_out, report);
   context.csv_out << CsvRow(input.sit_name, first_move, avg_metrics);
 }
@@ -573,9 +1083,10 @@ void BenchmarkSituations(BenchmarkContext& context) {
 // human-readable report. If `prev_csv_file` is not-empty, the report will
 // contain additional information comparing this benchmark to another benchmark.
 // The comparison file should be a csv file created previously by this
-// benchmark.
+// benchmark. `options` are used for every `Negamax` in the benchmark.
 void RunBenchmark(const std::string& description,
-                  const std::string& prev_csv_file) {
+                  const std::string& prev_csv_file,
+                  const NegamaxOptions& options = NegamaxOptions()) {
   using namespace benchmark_internal;
   const std::string benchmark_dir = "../benchmark_out/";
 
@@ -602,10 +1113,20 @@ void RunBenchmark(const std::string& description,
   csv_out << CsvHeaderRow();
 
   std::string timestamp = CurrentTimestamp();
-  StreamAndStdOut(report_out, BenchmarkSettings(description, timestamp));
+  StreamAndStdOut(report_out,
+                  BenchmarkSettings(description, timestamp, options));
+
+  StreamAndStdOut(report_out, TTThroughputTable(options));
+  StreamAndStdOut(report_out,
+                  TwoTierTTTable<10, 12>(options, StartingSituation<10, 12>()));
+  if (options.num_threads > 1) {
+    StreamAndStdOut(report_out,
+                    ParallelSearchTable<8, 8>(options,
+                                              StartingSituation<8, 8>()));
+  }
 
   std::ostringstream situations_out;
-  BenchmarkContext context{situations_out, csv_out, prev_csv_map};
+  BenchmarkContext context{options, situations_out, csv_out, prev_csv_map};
   BenchmarkSituations(context);
 
   if (!prev_csv_file.empty()) {
@@ -51,6 +51,19 @@ enum TTWrites {
 };
 constexpr int kNumTTWriteTypes = 4;
 
+// Contents of a TT, estimated from a sample of its entries (see
+// `TranspositionTable::SampleStats`). Fractions are in permille of the sampled
+// entries.
+struct TTStats {
+  long long sampled_entries = 0;
+  // Non-empty entries.
+  long long hashfull_permille = 0;
+  // Entries stored by earlier searches.
+  long long stale_permille = 0;
+  // Entries by depth.
+  std::array<long long, kMaxDepth + 1> depth_permille = {};
+};
+
 struct BenchmarkMetrics {
   long long wall_clock_time_ms = 0;
 
@@ -59,6 +72,113 @@ struct BenchmarkMetrics {
   // of the graph, such as computing the distance between two nodes.
   long long graph_primitives = 0;
 
+  // Number of situations visited by the search (calls to the search function).
+  long long nodes = 0;
+
+  // Lookups in the cache of distance maps (see `Negamax::GoalDistances`).
+  long long distance_cache_hits = 0;
+  long long distance_cache_misses = 0;
+
+  // Lookups in the cache of wall structures (see `Negamax::WallStructure`).
+  long long structure_cache_hits = 0;
+  long long structure_cache_misses = 0;
+
+  // Lookups in the cache of move lists (see `Negamax::CachedMoveList`).
+  long long move_list_cache_hits = 0;
+  long long move_list_cache_misses = 0;
+
+  // Nodes visited by the helper threads of a Lazy SMP search, which are not
+  // included in `nodes`.
+  long long helper_nodes = 0;
+
+  // The deepest ID iteration completed by the main thread, and the time since
+  // the start of the search and the nodes visited by all threads when each
+  // depth was completed. With Lazy SMP, the helper nodes are only counted up
+  // to their last completed ID iteration.
+  int completed_depth = 0;
+  std::array<long long, kMaxDepth + 1> time_to_depth_ms = {};
+  std::array<long long, kMaxDepth + 1> nodes_to_depth = {};
+
+  // With PVS (see `Negamax::SearchChild`), children searched with a null
+  // window, and those searched again with the full window because they turned
+  // out to be better than alpha, by the depth of the parent.
+  long long pvs_null_window_searches = 0;
+  std::array<long long, kMaxDepth + 1> pvs_re_searches = {};
+
+  long long TotalPVSReSearches() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth)
+      res += pvs_re_searches[depth];
+    return res;
+  }
+
+  // Killer moves searched before generating the moves of a situation (see
+  // `Negamax::killers_`), and those that caused a cutoff.
+  long long killer_searches = 0;
+  long long killer_cutoffs = 0;
+  // Killers and countermoves with buildable walls whose legality had to be
+  // checked with graph traversals, out of all those with buildable walls (see
+  // `Negamax::IsLegalKiller`).
+  long long killer_legality_checks = 0;
+  long long killer_legality_traversals = 0;
+  // Countermoves searched before generating the moves of a situation (see
+  // `Negamax::countermove_table_`), and those that caused a cutoff.
+  long long countermove_searches = 0;
+  long long countermove_cutoffs = 0;
+  // Situations whose search ended with a beta cutoff by one of their moves,
+  // not by the TT.
+  long long beta_cutoffs = 0;
+
+  // Late moves searched with a reduced depth (see
+  // `Negamax::SearchOrderedChild`), and those searched again with their full
+  // depth, by the depth of their parent.
+  std::array<long long, kMaxDepth + 1> lmr_searches = {};
+  std::array<long long, kMaxDepth + 1> lmr_re_searches = {};
+
+  long long TotalLMRSearches() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth)
+      res += lmr_searches[depth];
+    return res;
+  }
+
+  long long TotalLMRReSearches() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth)
+      res += lmr_re_searches[depth];
+    return res;
+  }
+
+  // Root searches of each ID iteration whose eval fell outside of the
+  // aspiration window (see `Negamax::AspirationSearch`), by depth, and the time
+  // spent searching the root again with a wider window.
+  std::array<long long, kMaxDepth + 1> aspiration_fail_lows = {};
+  std::array<long long, kMaxDepth + 1> aspiration_fail_highs = {};
+  std::array<long long, kMaxDepth + 1> aspiration_re_search_ms = {};
+
+  long long TotalAspirationReSearches() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth)
+      res += aspiration_fail_lows[depth] + aspiration_fail_highs[depth];
+    return res;
+  }
+
+  long long TotalAspirationReSearchMillis() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth)
+      res += aspiration_re_search_ms[depth];
+    return res;
+  }
+
+  // Split points searched in parallel (see `Negamax::SplitPoint`), and the
+  // children of split points searched by helper threads.
+  long long split_points = 0;
+  long long split_helper_moves = 0;
+
+  long long NodesPerSecond() const {
+    return wall_clock_time_ms > 0 ? nodes * 1000 / wall_clock_time_ms : 0;
+  }
+
   // Keep a counter for each possible exit out of the searsch function.
   // The first dimension is the depth. The second dimension is the type of exit.
   std::array<std::array<long long, kNumExitTypes>, kMaxDepth + 1> num_exits;
@@ -87,6 +207,17 @@ struct BenchmarkMetrics {
   std::array<long long, kMaxDepth + 1> tt_improvement_reads;
   std::array<long long, kMaxDepth + 1> tt_useless_reads;
 
+  // Reads of entries shallower than the node that are used anyway because they
+  // prove a win or a loss. They are also counted as one of the types above.
+  std::array<long long, kMaxDepth + 1> tt_decided_reads;
+
+  long long TotalTTDecidedReads() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth)
+      res += tt_decided_reads[depth];
+    return res;
+  }
+
   long long TTReadsAtDepthOfType(int depth, int read_type) const {
     switch (read_type) {
       case EXACT_READ:
@@ -128,10 +259,55 @@ struct BenchmarkMetrics {
     return res;
   }
 
+  // Lookups of the TT by the search, those that found an entry for the
+  // situation, whether or not its depth is enough to use its eval, and those
+  // found in the hot table of a two-tier TT.
+  long long tt_probes = 0;
+  long long tt_hits = 0;
+  long long tt_hot_hits = 0;
+
+  // Reads where the key of the situation is in the TT, but the stored move is
+  // illegal. This proves that the entry belongs to a different situation with
+  // the same key. It is a lower bound on the number of collisions, since a
+  // collision can also have a legal move, and exact hits return without
+  // checking the move.
+  std::array<long long, kMaxDepth + 1> tt_collision_reads;
+
+  long long TotalTTCollisionReads() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth)
+      res += tt_collision_reads[depth];
+    return res;
+  }
+
+  // Reads that actually look up the TT.
+  long long TotalTTProbes() const {
+    return TotalTTReads() - TTReadsOfType(NO_READ);
+  }
+
   // We only need to store these two types of writes. The others can be derived.
   std::array<long long, kMaxDepth + 1> tt_add_writes;
   std::array<long long, kMaxDepth + 1> tt_replace_writes;
 
+  // Entries evicted from the TT to make room for another situation, by the
+  // depth of the evicted entry (as opposed to the depth of the new entry, used
+  // for `tt_replace_writes`).
+  std::array<long long, kMaxDepth + 1> tt_evictions;
+
+  long long TotalTTEvictions() const {
+    long long res = 0;
+    for (int depth = 0; depth <= kMaxDepth; ++depth) res += tt_evictions[depth];
+    return res;
+  }
+
+  // Only with `kTTVerifyHits`: hits checked against the stored situation, and
+  // those where it was a different situation (a collision).
+  long long tt_verified_hits = 0;
+  long long tt_verified_collisions = 0;
+
+  // The contents of the TT at the end of the search.
+  TTStats tt_stats;
+
   long long TTWritesAtDepthOfType(int depth, int read_type) const {
     switch (read_type) {
       case UPDATE_WRITE:
@@ -204,8 +380,9 @@ struct BenchmarkMetrics {
   }
 };
 
-// Global object updated during the Negamax search using the macros below.
-BenchmarkMetrics global_metrics;
+// Global object updated during the Negamax search using the macros below. It is
+// thread-local so that threads sharing a TT do not race on the counters.
+thread_local BenchmarkMetrics global_metrics;
 
 #define METRIC_INC(metric)   \
   if (kBenchmark) {          \
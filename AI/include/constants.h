@@ -9,6 +9,130 @@ constexpr int kMaxDepth = 20;
 // Space allocated for the transposition table in mega bytes.
 constexpr int kTranspositionTableMB = 512;
 
+// Number of threads searching each move (see `NegamaxOptions::num_threads`).
+constexpr int kNumSearchThreads = 1;
+
+// Whether helper threads search split points instead of doing Lazy SMP (see
+// `NegamaxOptions::split_points`), and the minimum remaining depth of a split
+// point, so that each child is worth handing to another thread.
+constexpr bool kSplitPoints = false;
+constexpr int kMinSplitDepth = 2;
+
+// Whether the search uses a two-tier TT (see `NegamaxOptions::two_tier_tt`).
+constexpr bool kTwoTierTT = false;
+
+// Space allocated for the hot table of a two-tier TT in mega bytes. Small
+// enough to stay in the CPU's L2 cache.
+constexpr int kHotTTMB = 1;
+
+// In a two-tier TT, entries with at most this depth are stored in the hot
+// table, and deeper entries in the main table.
+constexpr int kHotTTMaxDepth = 2;
+
+// Depth that a TT entry loses, for replacement purposes, for each search since
+// it was stored. Between two searches of the same AI, the game advances two
+// plies, so an old entry is as relevant as a new one two plies shallower.
+constexpr int kTTAgePenalty = 2;
+
+// Whether the search uses Principal Variation Search (see
+// `NegamaxOptions::pvs`).
+constexpr bool kPVS = true;
+
+// Half-width of the aspiration windows of ID iterations (see
+// `NegamaxOptions::aspiration_window`), and the factor by which it grows when
+// the eval falls outside of the window. Disabled by default because, with PVS,
+// only the first root move is searched with a wide window, and narrowing it
+// saves almost no nodes.
+constexpr int kAspirationWindow = 0;
+constexpr int kAspirationWindowGrowth = 4;
+
+// Number of killer moves per ply (see `NegamaxOptions::num_killers`), and the
+// maximum. Disabled by default because the moves that caused cutoffs at the
+// same ply rarely cause them again in other situations, where their search
+// costs more nodes than it saves (e.g., 1.30M -> 2.37M nodes to depth 11 in
+// the Puzzle5 benchmark with 2 killers).
+constexpr int kNumKillers = 0;
+constexpr int kMaxKillers = 3;
+
+// Largest bonus that the history heuristic adds to the score of a generated
+// move (see `NegamaxOptions::history_weight`). The scores of `OrderedMoves`
+// differ by a few points between similar moves, and by 10 for each step
+// gained or lost, so the history reorders moves of the same kind.
+constexpr int kHistoryWeight = 8;
+
+// When an entry of the history tables exceeds this value, every entry is
+// halved, so that recent cutoffs weigh more than old ones.
+constexpr int kMaxHistory = 1 << 16;
+
+// Whether the search tries the countermove of the previous move (see
+// `NegamaxOptions::countermoves`), and the number of entries of the
+// countermove table of each player. It must be a power of two. Disabled by
+// default because few cutoffs are left to countermoves after the TT move,
+// the double-walk move and the killer moves, and searching them costs more
+// nodes than they save.
+constexpr bool kCountermoves = false;
+constexpr int kCountermoveTableSize = 4096;
+
+// Late move reductions (see `NegamaxOptions::lmr_reductions`): the number of
+// plies by which the search of a move is reduced, for situations searched
+// with each remaining depth (the last value applies to deeper ones), if the
+// move comes after the first `kLMRMinMoves` searched moves of the ordered list
+// of the situation, and its heuristic score is lower than `kLMRScoreThreshold`
+// (or, in the cached move lists near the root, regardless of the eval that
+// orders them). Enabled by default because the 10s benchmark searches reach
+// 2 more plies in 6 of its 9 situations (e.g., 1.29M -> 0.75M nodes to depth
+// 11 in Puzzle5, and depth 5 -> 7 in Empty-4x4).
+constexpr int kLMRReductions[] = {0, 0, 1, 1, 2};
+constexpr int kLMRMinMoves = 4;
+constexpr int kLMRScoreThreshold = 1;
+
+// Number of nodes between checks of the time left by the search, besides the
+// checks between the moves of the root. A node of a large board can take a
+// fraction of a millisecond, so this is small.
+constexpr int kTimeCheckNodes = 64;
+
+// Number of moves ahead, in the list of moves of a node, for which the search
+// prefetches the TT bucket of the child situation. 0 disables prefetching.
+constexpr int kTTPrefetchDistance = 1;
+
+// Number of graphs for which the search caches the distances from each node to
+// each goal. It must be a power of two. Small enough that the cache stays in
+// the CPU's L2 cache on large boards.
+constexpr int kDistanceCacheSize = 1024;
+
+// Number of wall layouts for which the search caches their bridges and
+// 2-edge-connected components (see `Negamax::WallStructure`). It must be a
+// power of two.
+constexpr int kStructureCacheSize = 1024;
+
+// The search keeps the ordered move lists of situations at plies lower than
+// `kMoveListCachePlies` from the root, up to `kMoveListCacheSize` of them, so
+// that each ID iteration reuses them, reordered by the results of the previous
+// one, instead of generating them again.
+constexpr int kMoveListCachePlies = 2;
+constexpr int kMoveListCacheSize = 64;
+
+// Whether a situation and its mirror image (see `Situation::mirror_hash`)
+// share their TT entry. This is approximate because the draw rule is not
+// symmetric.
+constexpr bool kMirrorSymmetry = false;
+
+// Number of TT buckets sampled to estimate the contents of the TT (see
+// `TranspositionTable::SampleStats`).
+constexpr long long kTTStatsSampleBuckets = 1024;
+
+// Debug mode where the TT also stores the full situation of each entry, so
+// that hits can be checked against it to count collisions exactly. Each
+// situation takes several times the memory of its entry, so only TTs of at
+// most `kTTVerifyHitsMaxEntries` entries are verified. The situations are not
+// stored atomically, so TTs shared with helper threads (see
+// `NegamaxOptions::num_threads`) are not verified either.
+constexpr bool kTTVerifyHits = false;
+constexpr long long kTTVerifyHitsMaxEntries = 1 << 20;  // A 16 MB TT.
+
+// Seed for the random keys used to hash situations (see zobrist.h).
+constexpr unsigned long long kZobristSeed = 0x5EED0F3A11BA11ULL;
+
 constexpr int kInteractiveGameR = 8;
 constexpr int kInteractiveGameC = 8;
 constexpr int kInteractiveGameMillis = 20000;
@@ -18,6 +142,8 @@ constexpr bool kBenchmark = true;
 
 constexpr int kBenchmarkNumSamples = 2;
 constexpr int kBenchmarksearchTimeMillis = 10000;
+// Number of TT operations done by each thread in the TT throughput benchmark.
+constexpr long long kBenchmarkTTOpsPerThread = 2000000;
 
 constexpr int kBrowserR = 7;
 constexpr int kBrowserC = 7;
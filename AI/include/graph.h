@@ -163,6 +163,19 @@ constexpr bool IsRealEdge(int R, int C, int e) {
                               : !IsFakeVerticalEdge(R, C, e));
 }
 
+// The reflection of the board across its vertical axis. Fake edges, which are
+// not part of the board, are their own reflection.
+constexpr int MirroredNode(int C, int v) {
+  return NodeAt(C, Row(C, v), C - 1 - Col(C, v));
+}
+constexpr int MirroredEdge(int C, int e) {
+  if (!IsHorizontalEdge(e)) return 2 * MirroredNode(C, EndpointAbove(e)) + 1;
+  if (IsFakeHorizontalEdge(C, e)) return e;
+  // The reflection of the edge to the right of v is the edge to the left of
+  // the reflection of v.
+  return 2 * (MirroredNode(C, EndpointLeft(e)) - 1);
+}
+
 template <int R, int C>
 std::bitset<NumRealAndFakeEdges(R, C)> PathAsEdgeSet(
     std::array<int, NumNodes(R, C)> path) {
@@ -531,7 +544,7 @@ struct Graph {
   // Returns the set of edges which are bridges.
   std::bitset<NumRealAndFakeEdges(R, C)> Bridges() const {
     METRIC_INC(graph_primitives);
-    static BridgesState state;
+    thread_local BridgesState state;
     state.rank.fill(-1);
     state.next_rank = 0;
     state.low_link.fill(-1);
@@ -0,0 +1,54 @@
+#ifndef GRAPH_CACHE_H_
+#define GRAPH_CACHE_H_
+
+#include <cstdint>
+#include <vector>
+
+namespace wallwars {
+
+// A direct-mapped cache from graph hashes (see `Situation::GraphHash`) to
+// values of type `V` computed from the graph, such as distance maps. Unlike the
+// TT, it stores whole 64-bit hashes, so lookups are only wrong if two graphs
+// have the same hash. It is meant to be small enough to stay in the CPU caches:
+// `N` is the number of slots, which must be a power of two. A new value simply
+// overwrites the previous value in its slot.
+template <typename V, int N>
+class GraphCache {
+  static_assert(N > 0 && (N & (N - 1)) == 0,
+                "The number of slots should be a power of two");
+
+ public:
+  // Allocated on the heap because values can be large.
+  GraphCache() : slots_(N) {}
+
+  // Returns the value cached for `graph_hash`, or nullptr if there is none.
+  inline const V* Find(uint64_t graph_hash) const {
+    const Slot& slot = slots_[graph_hash & (N - 1)];
+    return slot.occupied && slot.graph_hash == graph_hash ? &slot.value
+                                                          : nullptr;
+  }
+
+  // Caches `value` for `graph_hash` and returns a reference to the cached copy.
+  inline const V& Insert(uint64_t graph_hash, const V& value) {
+    Slot& slot = slots_[graph_hash & (N - 1)];
+    slot.occupied = true;
+    slot.graph_hash = graph_hash;
+    slot.value = value;
+    return slot.value;
+  }
+
+ private:
+  struct Slot {
+    // The graph without walls has hash 0, so it can't be used to mark empty
+    // slots.
+    bool occupied = false;
+    uint64_t graph_hash;
+    V value;
+  };
+
+  std::vector<Slot> slots_;
+};
+
+}  // namespace wallwars
+
+#endif  // GRAPH_CACHE_H_
@@ -4,6 +4,7 @@
 #include <array>
 #include <chrono>
 #include <ctime>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -23,12 +24,36 @@ class InteractiveGame {
   static constexpr int R = kInteractiveGameR;
   static constexpr int C = kInteractiveGameC;
 
-  static void PlayGame() {
+  static void PlayGame(const NegamaxOptions& options = NegamaxOptions()) {
     InteractiveGame game;
+    game.options_ = options;
     game.Play();
   }
 
+  // Searches the starting situation for `millis` milliseconds and saves the
+  // TT to `options.tt_file`, so that later games with the same file start
+  // from this analysis. If the file already exists, the analysis continues
+  // from it.
+  static void AnalyzeStartingSituation(const NegamaxOptions& options,
+                                       int millis) {
+    if (options.tt_file.empty()) {
+      std::cout << "Analysis needs a TT file (--tt_file=path)." << std::endl;
+      return;
+    }
+    NegamaxOptions analysis_options = options;
+    if (!std::ifstream(options.tt_file).good()) analysis_options.tt_file = "";
+    Negamax<R, C> negamaxer(analysis_options);
+    Situation<R, C> sit = StartingSituation<R, C>();
+    Move move = negamaxer.GetMove(sit, millis);
+    std::cout << "Best move: " << sit.MoveToString(move) << std::endl;
+    if (negamaxer.SaveTT(options.tt_file)) {
+      std::cout << "Saved TT to " << options.tt_file << std::endl;
+    }
+  }
+
  private:
+  NegamaxOptions options_;
+
   void Play() {
     std::array<bool, 2> auto_moves = {true, true};
     while (true) {
@@ -140,7 +165,8 @@ class InteractiveGame {
   // `auto_moves` is an array which indicates, for P0 and P1, whether
   // the AI should make the move.
   void PlayGame(std::array<bool, 2> auto_moves) {
-    std::array<Negamax<R, C>, 2> negamaxers;
+    std::array<Negamax<R, C>, 2> negamaxers = {Negamax<R, C>(options_),
+                                               Negamax<R, C>(options_)};
 
     Situation<R, C> sit = StartingSituation<R, C>();
     for (int ply = 0; !sit.IsGameOver(); ++ply) {
@@ -158,7 +184,7 @@ class InteractiveGame {
               : GetHumanMove(sit, negamaxers[sit.turn]);
       auto stop_time = high_resolution_clock::now();
       seconds duration_s = duration_cast<seconds>(stop_time - start_time);
-      if (move == Move{0, {-1, -1}}) {
+      if (move == NullMove()) {
         std::cout << "Internal error" << std::endl;
         return;
       } else {
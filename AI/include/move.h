@@ -40,6 +40,10 @@ inline Move DoubleBuildMove(int edge1, int edge2) {
   return {0, {edge1, edge2}};
 }
 
+// A move without any action. It is never legal, so it is used to represent
+// the absence of a move.
+inline Move NullMove() { return {0, {-1, -1}}; }
+
 inline std::ostream& operator<<(std::ostream& os, const Move& m) {
   return os << m.token_change << " (" << m.edges[0] << " " << m.edges[1] << ")";
 }
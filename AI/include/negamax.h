@@ -1,21 +1,105 @@
 #ifndef NEGAMAX_H_
 #define NEGAMAX_H_
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <bitset>
 #include <chrono>
+#include <condition_variable>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "benchmark_metrics.h"
 #include "constants.h"
 #include "external/span.h"
 #include "graph.h"
+#include "graph_cache.h"
 #include "macro_utils.h"
 #include "move.h"
 #include "situation.h"
 #include "transposition_table.h"
 
 namespace wallwars {
+
+// Settings of a `Negamax` that can be chosen at runtime, e.g., from the
+// command line. The defaults come from constants.h.
+struct NegamaxOptions {
+  // Space allocated for the transposition table in mega bytes. It is rounded
+  // down to a power of two number of TT buckets.
+  long long tt_mb = kTranspositionTableMB;
+  // If not empty, the TT starts as the table saved in this file instead of
+  // empty (see `TranspositionTable::Load`). The file must have been saved for
+  // the same board dimensions.
+  std::string tt_file;
+  // Number of moves ahead for which the search prefetches the TT bucket of the
+  // child situation. 0 disables prefetching.
+  int tt_prefetch_distance = kTTPrefetchDistance;
+  // Whether a situation and its mirror image share their TT entry (see
+  // `Situation::mirror_hash`). The mirror image is strategically equivalent
+  // except for the draw rule, which only favors P1, so evals may be slightly
+  // off when a draw is within the search horizon.
+  bool mirror_symmetry = kMirrorSymmetry;
+  // Whether entries of shallow nodes (see `kHotTTMaxDepth`), which are the
+  // most numerous and the cheapest to recompute, are stored in a small hot
+  // table instead of the main TT, so that they do not evict deep entries.
+  bool two_tier_tt = kTwoTierTT;
+  // Whether the search uses Principal Variation Search (see
+  // `Negamax::SearchChild`).
+  bool pvs = kPVS;
+  // Half-width of the initial window of each ID iteration around the eval of
+  // an earlier one (see `Negamax::AspirationSearch`). 0 searches every
+  // iteration with the full window.
+  int aspiration_window = kAspirationWindow;
+  // Number of killer moves per ply, at most `kMaxKillers`, tried in each
+  // situation before generating its moves. 0 disables them.
+  int num_killers = kNumKillers;
+  // Largest bonus added to the score of a generated move for the cutoffs
+  // caused by its walls and its walk direction elsewhere in the search (see
+  // `Negamax::HistoryScore`). 0 disables the history heuristic.
+  int history_weight = kHistoryWeight;
+  // Whether each situation, before generating its moves, tries the move that
+  // last caused a cutoff in reply to the move that led to it (see
+  // `Negamax::countermove_table_`).
+  bool countermoves = kCountermoves;
+  // Late move reductions: the number of plies by which moves that are late
+  // in the ordered list of a situation, and have a low heuristic score, are
+  // searched less deeply, for situations with each remaining depth. The last
+  // value applies to deeper situations, and an empty list disables them. A
+  // reduced move is searched with a null window, and searched again with its
+  // full depth if it turns out to be better than alpha (see
+  // `Negamax::SearchOrderedChild`).
+  std::vector<int> lmr_reductions{std::begin(kLMRReductions),
+                                  std::end(kLMRReductions)};
+  // Number of moves of the ordered list of a situation searched before the
+  // first move that can be reduced, and heuristic score below which moves can
+  // be reduced. Moves of the list that are skipped, like killers searched
+  // before the list or illegal moves, do not count. The moves
+  // of the cached lists near the root are ordered by their evals from the
+  // previous ID iteration instead, so there only the index matters.
+  int lmr_min_moves = kLMRMinMoves;
+  int lmr_score_threshold = kLMRScoreThreshold;
+  // Number of threads searching each move. The main thread does the usual
+  // search, and returns its result, while `num_threads - 1` helper threads
+  // share the TT with it. By default (Lazy SMP), each helper runs its own
+  // iterative deepening on the same situation, starting at depth 1 or 2
+  // (alternating between helpers) so that half of them search one ply deeper
+  // than the other half, and only contributes through the TT entries it
+  // stores.
+  int num_threads = kNumSearchThreads;
+  // Whether the helpers search split points of the main thread instead (see
+  // `Negamax::SplitPoint`).
+  bool split_points = kSplitPoints;
+};
+
 template <int R, int C>
 class Negamax {
   static constexpr int kGameOverEval = 999;  // Larger than any real evaluation.
@@ -23,7 +107,42 @@ class Negamax {
   static constexpr int kPossiblyIllegalMoveScore = -5000;
   static constexpr int kWinningMoveScore = 10000;
 
-  TranspositionTable<R, C> TT;
+  // The TTs are owned by the main searcher and shared with its helpers.
+  std::unique_ptr<TranspositionTable<R, C>> owned_TT_;
+  std::unique_ptr<TranspositionTable<R, C>> owned_hot_TT_;
+  TranspositionTable<R, C>& TT;
+  // Only used with `two_tier_tt_`. Allocated anyway because it is small.
+  TranspositionTable<R, C>& hot_TT;
+
+  // Distances fit in a byte on all but huge boards.
+  using DistanceType =
+      std::conditional_t<NumNodes(R, C) <= 128, int8_t, int16_t>;
+  // The distances from each node to each player's goal (see `GoalDistances`).
+  using GoalDistanceMaps =
+      std::array<std::array<DistanceType, NumNodes(R, C)>, 2>;
+  GraphCache<GoalDistanceMaps, kDistanceCacheSize> distance_cache_;
+
+  // The analysis of a wall layout needed by `OrderedMoves`, which does not
+  // depend on the tokens or the turn.
+  struct WallStructure {
+    std::bitset<NumRealAndFakeEdges(R, C)> bridges;
+    // The 2-edge-connected component of each node, as returned by
+    // `Graph::TwoEdgeConnectedComponents`.
+    std::array<DistanceType, NumNodes(R, C)> two_edge_connected_components;
+  };
+  GraphCache<WallStructure, kStructureCacheSize> structure_cache_;
+
+  // The output of `OrderedMoves`: one array for each depth of the search, with
+  // enough space for every move. They are per searcher, rather than
+  // thread-local, because they are too large for the stacks of helper threads,
+  // which also hold the thread-local storage.
+  using MoveLists =
+      std::array<std::array<ScoredMove, MaxNumLegalMoves(R, C)>, kMaxDepth>;
+  std::unique_ptr<MoveLists> move_lists_{new MoveLists};
+
+  // Move lists of situations near the root, by hash (see `CachedMoveList`).
+  // Cleared at the start of each search.
+  std::unordered_map<uint64_t, std::vector<ScoredMove>> move_list_cache_;
 
   // The situation that moves are applied to to traverse the search tree.
   Situation<R, C> sit_;
@@ -32,33 +151,241 @@ class Negamax {
   std::chrono::high_resolution_clock::time_point search_start_timestamp;
   int search_millis;
 
+  int tt_prefetch_distance_;
+  bool mirror_symmetry_;
+  bool two_tier_tt_;
+  bool pvs_;
+  int aspiration_window_;
+  int num_killers_;
+  // For each ply, the last moves that caused a cutoff in a situation at that
+  // ply, most recent first. Cleared at the start of each search.
+  std::array<std::array<Move, kMaxKillers>, kMaxDepth + 1> killers_;
+  int history_weight_;
+  // For each player, the cutoffs caused by moves that build each edge, and by
+  // moves with each token change (offset by `2 * C`, so that every change of
+  // one or two steps is a valid index), weighted by the square of their depth.
+  // `max_history_` is the largest entry. Cleared at the start of each search.
+  std::array<std::array<int, NumRealAndFakeEdges(R, C)>, 2> wall_history_;
+  std::array<std::array<int, 4 * C + 1>, 2> walk_history_;
+  int max_history_;
+  bool countermoves_;
+  // For each player, the last move that caused a cutoff in reply to each move
+  // of the opponent, in a direct-mapped table indexed by a hash of the
+  // opponent's move (see `CountermoveIndex`), which is stored along with the
+  // reply to tell apart moves with the same index. Cleared at the start of
+  // each search.
+  struct Countermove {
+    Move prev_move;
+    Move move;
+  };
+  std::array<std::array<Countermove, kCountermoveTableSize>, 2>
+      countermove_table_;
+  // The reduction of late moves by remaining depth (see
+  // `NegamaxOptions::lmr_reductions`).
+  std::array<int, kMaxDepth + 1> lmr_reductions_;
+  int lmr_min_moves_;
+  int lmr_score_threshold_;
+  // The root eval of each ID iteration of the current search.
+  std::array<int, kMaxDepth + 1> iteration_evals_;
+
+  // Parallel search (see `NegamaxOptions::num_threads`). Only the main
+  // searcher has helpers. Helpers abandon their search when `*stop_` is set,
+  // which points to the flag of the main searcher.
+  std::vector<std::unique_ptr<Negamax>> helpers_;
+  bool is_helper_ = false;
+  std::atomic<bool> stop_helpers_{false};
+  const std::atomic<bool>* stop_ = &stop_helpers_;
+  // Nodes visited by a helper in its current search, updated after each ID
+  // iteration or split point.
+  std::atomic<long long> helper_nodes_{0};
+
+  // Young Brothers Wait Concept: once the first child of a node has been
+  // searched by the main thread, the remaining children are searched in
+  // parallel. Each searcher, including the main thread, takes the next
+  // unsearched child, starting from the alpha found so far by its siblings,
+  // until every child is searched or one of them causes a cutoff.
+  struct SplitPoint {
+    Situation<R, C> sit;
+    int depth;
+    int ply;
+    int beta;
+    nonstd::span<const ScoredMove> moves;
+    // Results of each move for `RefineMoveList`, or nullptr.
+    std::vector<int>* move_evals;
+    // Killer moves and countermove already searched, which are skipped.
+    nonstd::span<const ScoredMove> searched_killers;
+    // Index in `moves` of the next child to search.
+    std::atomic<int> next_move;
+    // Set on a cutoff or when the main thread runs out of time. Abandons the
+    // searches of the children in progress.
+    std::atomic<bool> abort{false};
+    // Guards the fields below.
+    std::mutex mutex;
+    int alpha;
+    ScoredMove best_move;
+    // Index of `best_move` in `moves`, to break ties in favor of the move
+    // that would be chosen by a serial search. -1 for moves searched before
+    // the split.
+    int best_move_index;
+    // Number of moves of `moves` searched so far, including before the split
+    // (see `SearchOrderedChild`).
+    int num_searched_moves;
+    long long helper_moves = 0;
+  };
+  bool split_points_;
+  // Searchers other than the main thread that take part in a split point.
+  // Guarded by `split_mutex_` of the main searcher.
+  int split_workers_ = 0;
+  // The split point searched by the main thread, if any, and a counter of
+  // split points so that helpers do not join the same one twice.
+  SplitPoint* split_point_ = nullptr;
+  long long split_point_count_ = 0;
+  std::mutex split_mutex_;
+  // Notified when there is a new split point or the helpers must stop.
+  std::condition_variable split_cv_;
+  // Notified when the last helper leaves a split point.
+  std::condition_variable split_done_cv_;
+  // The main searcher, for helpers.
+  Negamax* main_ = this;
+  // The abort flag of the split point whose child this searcher is searching.
+  const std::atomic<bool>* split_abort_ = nullptr;
+
+  // The best move and eval found by the last search of the root, which may
+  // not be in the TT anymore if a helper overwrote the root entry.
+  ScoredMove root_result_;
+  // Whether the last ID iteration ran out of time before searching every root
+  // move.
+  bool root_search_aborted_;
+  // Whether the main searcher ran out of time in the middle of the search of a
+  // root move, which is then abandoned like the search of a stopped helper.
+  bool out_of_time_ = false;
+  int nodes_since_time_check_ = 0;
+
+  // A helper searcher, which shares the TTs and the settings of `main`. The
+  // tag keeps it from being mistaken for a copy constructor.
+  struct HelperTag {};
+  Negamax(HelperTag, Negamax& main)
+      : TT(main.TT),
+        hot_TT(main.hot_TT),
+        tt_prefetch_distance_(main.tt_prefetch_distance_),
+        mirror_symmetry_(main.mirror_symmetry_),
+        two_tier_tt_(main.two_tier_tt_),
+        pvs_(main.pvs_),
+        aspiration_window_(main.aspiration_window_),
+        num_killers_(main.num_killers_),
+        history_weight_(main.history_weight_),
+        countermoves_(main.countermoves_),
+        lmr_reductions_(main.lmr_reductions_),
+        lmr_min_moves_(main.lmr_min_moves_),
+        lmr_score_threshold_(main.lmr_score_threshold_),
+        is_helper_(true),
+        stop_(&main.stop_helpers_),
+        split_points_(main.split_points_),
+        main_(&main) {}
+
  public:
+  explicit Negamax(const NegamaxOptions& options = NegamaxOptions())
+      : owned_TT_(new TranspositionTable<R, C>(options.tt_mb)),
+        owned_hot_TT_(new TranspositionTable<R, C>(kHotTTMB)),
+        TT(*owned_TT_),
+        hot_TT(*owned_hot_TT_),
+        tt_prefetch_distance_(options.tt_prefetch_distance),
+        mirror_symmetry_(options.mirror_symmetry),
+        two_tier_tt_(options.two_tier_tt),
+        pvs_(options.pvs),
+        aspiration_window_(options.aspiration_window),
+        num_killers_(std::min(options.num_killers, kMaxKillers)),
+        history_weight_(options.history_weight),
+        countermoves_(options.countermoves),
+        lmr_min_moves_(options.lmr_min_moves),
+        lmr_score_threshold_(options.lmr_score_threshold),
+        split_points_(options.split_points) {
+    // If loading fails, the error is printed and the search starts from an
+    // empty TT.
+    if (!options.tt_file.empty()) TT.Load(options.tt_file);
+    for (int depth = 0; depth <= kMaxDepth; ++depth) {
+      lmr_reductions_[depth] =
+          options.lmr_reductions.empty()
+              ? 0
+              : options.lmr_reductions[std::min<size_t>(
+                    depth, options.lmr_reductions.size() - 1)];
+    }
+    if (options.num_threads > 1) {
+      TT.StopVerifyingHits();
+      hot_TT.StopVerifyingHits();
+    }
+    for (int i = 1; i < options.num_threads; ++i) {
+      helpers_.emplace_back(new Negamax(HelperTag(), *this));
+    }
+  }
+
+  // Helpers point to their main searcher, and only the main searcher owns
+  // the TTs, so searchers cannot be copied.
+  Negamax(const Negamax&) = delete;
+  Negamax& operator=(const Negamax&) = delete;
+
+  // Saves the TT so that a later `Negamax` can start from the results of this
+  // one's searches. Returns whether it succeeded.
+  bool SaveTT(const std::string& path) const { return TT.Save(path); }
+
+  // Returns an estimate of the contents of the TT.
+  TTStats TTStatistics() const { return TT.SampleStats(); }
+
   Move GetMove(Situation<R, C> sit, int millis) {
     search_start_timestamp = std::chrono::high_resolution_clock::now();
     search_millis = millis;
     sit_ = sit;
-    for (ID_depth = 1; ID_depth < kMaxDepth; ++ID_depth) {
-      int alpha = -2 * kGameOverEval;
-      int beta = 2 * kGameOverEval;
+    // `sit` may have been built by modifying its fields directly.
+    sit_.RecomputeHash();
+    TT.NewSearch();
+    hot_TT.NewSearch();
+    move_list_cache_.clear();
+    for (auto& killers : killers_) killers.fill(NullMove());
+    ClearHistory();
+    ClearCountermoves();
+    out_of_time_ = false;
+    nodes_since_time_check_ = 0;
+
+    std::vector<std::thread> helper_threads;
+    stop_helpers_ = false;
+    for (size_t i = 0; i < helpers_.size(); ++i) {
+      Negamax* helper = helpers_[i].get();
+      // `sit_` changes during the search, so each helper gets a copy.
+      helper_threads.emplace_back([helper, i, root = sit_, this] {
+        if (split_points_) {
+          helper->SplitPointWorker();
+        } else {
+          helper->HelperSearch(root, 1 + (i + 1) % 2);
+        }
+      });
+    }
 
+    for (ID_depth = 1; ID_depth < kMaxDepth; ++ID_depth) {
       std::cout << "Search depth " << ID_depth << " with "
                 << millis - MillisSince(search_start_timestamp)
                 << " millis left." << std::endl;
 
-      // The search store the best move in the TT.
-      NegamaxEval(ID_depth, alpha, beta);
+      AspirationSearch();
+      if (kBenchmark && !root_search_aborted_) {
+        global_metrics.completed_depth = ID_depth;
+        global_metrics.time_to_depth_ms[ID_depth] =
+            MillisSince(search_start_timestamp);
+        global_metrics.nodes_to_depth[ID_depth] = global_metrics.nodes;
+        for (const auto& helper : helpers_) {
+          global_metrics.nodes_to_depth[ID_depth] += helper->helper_nodes_;
+        }
+      }
 
-      TTEntry<R, C>& entry = TT.Entry(TT.Location(sit));
       std::cout << "Best move: "
-                << sit.MoveToStandardNotation(MoveInTTEntry(entry))
-                << " (eval: " << entry.eval << ")" << std::endl;
+                << sit.MoveToStandardNotation(root_result_.move)
+                << " (eval: " << root_result_.score << ")" << std::endl;
 
-      if (entry.eval >= kGameOverEval) {
+      if (root_result_.score >= kGameOverEval) {
         std::cout << "Found winning move at depth " << ID_depth << "."
                   << std::endl;
         break;
       }
-      if (entry.eval <= -kGameOverEval) {
+      if (root_result_.score <= -kGameOverEval) {
         std::cout << "Position is lost at depth " << ID_depth << "."
                   << std::endl;
         break;
@@ -66,26 +393,279 @@ class Negamax {
       if (millis - MillisSince(search_start_timestamp) <= 0) break;
     }
 
-    // Fetch best move from TT.
-    TTEntry<R, C> entry = TT.Entry(TT.Location(sit));
-    assert(entry.alpha_beta_flag == kExactFlag);
-    Move move = {entry.token_change, {entry.edge0, entry.edge1}};
+    {
+      std::lock_guard<std::mutex> lock(split_mutex_);
+      stop_helpers_ = true;
+    }
+    split_cv_.notify_all();
+    for (std::thread& thread : helper_threads) thread.join();
+    for (const auto& helper : helpers_) {
+      METRIC_ADD(helper_nodes, helper->helper_nodes_);
+    }
+
+    Move move = root_result_.move;
     sit.CrashIfMoveIsIllegal(move);
     return move;
   }
 
+  // Searches the root at depth `ID_depth`, with a window of
+  // `aspiration_window_` around the eval of the ID iteration two plies
+  // shallower, which is usually close, and is cheaper to search than the full
+  // window. The search is repeated with a wider window if the eval turns out to
+  // be outside of it. The eval of the previous iteration is not used because
+  // evals alternate between odd and even depths, depending on which player
+  // moves last.
+  void AspirationSearch() {
+    const ScoredMove previous_result = root_result_;
+    int alpha = -2 * kGameOverEval;
+    int beta = 2 * kGameOverEval;
+    int window = aspiration_window_;
+    if (ID_depth > 2 && window > 0 &&
+        std::abs(iteration_evals_[ID_depth - 2]) < kGameOverEval) {
+      alpha = iteration_evals_[ID_depth - 2] - window;
+      beta = iteration_evals_[ID_depth - 2] + window;
+    }
+    root_search_aborted_ = false;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool is_re_search = false;
+    int eval;
+    while (true) {
+      eval = NegamaxEval(ID_depth, 0, alpha, beta, NullMove());
+      if (is_re_search) {
+        METRIC_ADD(aspiration_re_search_ms[ID_depth], MillisSince(start));
+      }
+      if (root_search_aborted_) break;
+      window *= kAspirationWindowGrowth;
+      if (eval <= alpha && alpha > -2 * kGameOverEval) {
+        METRIC_INC(aspiration_fail_lows[ID_depth]);
+        alpha = eval - window <= -kGameOverEval ? -2 * kGameOverEval
+                                                : eval - window;
+      } else if (eval >= beta && beta < 2 * kGameOverEval) {
+        METRIC_INC(aspiration_fail_highs[ID_depth]);
+        beta = eval + window >= kGameOverEval ? 2 * kGameOverEval
+                                              : eval + window;
+      } else {
+        break;
+      }
+      is_re_search = true;
+      start = std::chrono::high_resolution_clock::now();
+    }
+    // Moves that fail low are only known to be worse than the window, so the
+    // result of the previous iteration is safer than one of them.
+    if (root_search_aborted_ && root_result_.score <= alpha) {
+      root_result_ = previous_result;
+    }
+    if (!root_search_aborted_) iteration_evals_[ID_depth] = eval;
+  }
+
+  // The Lazy SMP search of a helper thread: iterative deepening from
+  // `first_depth` until the main searcher sets the stop flag.
+  void HelperSearch(const Situation<R, C>& sit, int first_depth) {
+    global_metrics = {};
+    helper_nodes_ = 0;
+    sit_ = sit;
+    move_list_cache_.clear();
+    for (auto& killers : killers_) killers.fill(NullMove());
+    ClearHistory();
+    ClearCountermoves();
+    for (ID_depth = first_depth; ID_depth < kMaxDepth && !IsStopped();
+         ++ID_depth) {
+      NegamaxEval(ID_depth, 0, -2 * kGameOverEval, 2 * kGameOverEval,
+                  NullMove());
+      helper_nodes_ = global_metrics.nodes;
+    }
+    helper_nodes_ = global_metrics.nodes;
+  }
+
+  // The search of a helper thread with split points: joins each split point
+  // of the main searcher until it sets the stop flag.
+  void SplitPointWorker() {
+    global_metrics = {};
+    helper_nodes_ = 0;
+    move_list_cache_.clear();
+    for (auto& killers : killers_) killers.fill(NullMove());
+    ClearHistory();
+    ClearCountermoves();
+    long long last_split_point = -1;
+    while (true) {
+      SplitPoint* split_point;
+      {
+        std::unique_lock<std::mutex> lock(main_->split_mutex_);
+        main_->split_cv_.wait(lock, [this, last_split_point] {
+          return IsStopped() || (main_->split_point_ != nullptr &&
+                                 main_->split_point_count_ != last_split_point);
+        });
+        if (IsStopped()) return;
+        split_point = main_->split_point_;
+        last_split_point = main_->split_point_count_;
+        ++main_->split_workers_;
+      }
+      sit_ = split_point->sit;
+      SearchSplitPoint(*split_point);
+      helper_nodes_ = global_metrics.nodes;
+      {
+        std::lock_guard<std::mutex> lock(main_->split_mutex_);
+        if (--main_->split_workers_ == 0) main_->split_done_cv_.notify_all();
+      }
+    }
+  }
+
+  // Searches the children of `split_point` until there are none left or it is
+  // aborted. `sit_` must be the situation of the split point.
+  void SearchSplitPoint(SplitPoint& split_point) {
+    const int num_moves = static_cast<int>(split_point.moves.size());
+    while (!split_point.abort) {
+      const int i = split_point.next_move++;
+      if (i >= num_moves) break;
+      const ScoredMove& scored_move = split_point.moves[i];
+      const Move& move = scored_move.move;
+      const ScoredMove* killer =
+          FindMove(split_point.searched_killers.data(),
+                   static_cast<int>(split_point.searched_killers.size()), move);
+      if (killer != nullptr) {
+        if (split_point.move_evals != nullptr) {
+          (*split_point.move_evals)[i] = killer->score;
+        }
+        continue;
+      }
+      if (scored_move.score == kPossiblyIllegalMoveScore &&
+          !sit_.IsLegalMove(move)) {
+        if (split_point.move_evals != nullptr) {
+          (*split_point.move_evals)[i] = kIllegalMove;
+        }
+        continue;
+      }
+      int alpha, num_searched_moves;
+      {
+        std::lock_guard<std::mutex> lock(split_point.mutex);
+        alpha = split_point.alpha;
+        num_searched_moves = split_point.num_searched_moves++;
+      }
+      split_abort_ = &split_point.abort;
+      int move_eval =
+          SearchOrderedChild(scored_move, num_searched_moves, split_point.depth,
+                             split_point.ply, alpha, split_point.beta, false,
+                             split_point.move_evals != nullptr);
+      const bool aborted = IsStopped();
+      split_abort_ = nullptr;
+      if (aborted) {
+        // The helpers cannot finish the split point without the main thread.
+        if (out_of_time_) split_point.abort = true;
+        break;
+      }
+
+      std::lock_guard<std::mutex> lock(split_point.mutex);
+      if (split_point.move_evals != nullptr) {
+        (*split_point.move_evals)[i] = move_eval;
+      }
+      if (is_helper_) ++split_point.helper_moves;
+      ScoredMove& best_move = split_point.best_move;
+      if (move_eval > best_move.score ||
+          (move_eval == best_move.score && i < split_point.best_move_index)) {
+        best_move = {move, move_eval};
+        split_point.best_move_index = i;
+        if (move_eval > split_point.alpha) {
+          split_point.alpha = move_eval;
+          if (split_point.alpha >= split_point.beta) split_point.abort = true;
+        }
+      }
+      // Same as the time check of the serial search.
+      if (!is_helper_ && ID_depth > 1 && split_point.depth == ID_depth &&
+          MillisSince(search_start_timestamp) > search_millis) {
+        std::cout << "Did not finish search at depth " << ID_depth << std::endl;
+        root_search_aborted_ = true;
+        split_point.abort = true;
+      }
+    }
+  }
+
+  // Whether the main thread can turn the node being searched into a split
+  // point. Split points are not nested, so children searched as part of a
+  // split point are searched serially.
+  inline bool CanSplit(int depth) const {
+    return split_points_ && !is_helper_ && !helpers_.empty() &&
+           split_abort_ == nullptr && depth >= kMinSplitDepth;
+  }
+
+  // Searches the moves of `sit_` from index `first_move` in parallel, and
+  // updates `alpha` and `best_move` with their results. `num_searched_moves`
+  // moves before `first_move` were searched.
+  void SplitSearch(int depth, int ply, int& alpha, int beta,
+                   nonstd::span<const ScoredMove> moves, int first_move,
+                   int num_searched_moves, std::vector<int>* move_evals,
+                   nonstd::span<const ScoredMove> searched_killers,
+                   ScoredMove& best_move) {
+    SplitPoint split_point;
+    split_point.sit = sit_;
+    split_point.depth = depth;
+    split_point.ply = ply;
+    split_point.beta = beta;
+    split_point.moves = moves;
+    split_point.move_evals = move_evals;
+    split_point.searched_killers = searched_killers;
+    split_point.next_move = first_move;
+    split_point.alpha = alpha;
+    split_point.best_move = best_move;
+    split_point.best_move_index = -1;
+    split_point.num_searched_moves = num_searched_moves;
+    {
+      std::lock_guard<std::mutex> lock(split_mutex_);
+      split_point_ = &split_point;
+      ++split_point_count_;
+    }
+    split_cv_.notify_all();
+    SearchSplitPoint(split_point);
+    {
+      std::unique_lock<std::mutex> lock(split_mutex_);
+      split_point_ = nullptr;
+      split_done_cv_.wait(lock, [this] { return split_workers_ == 0; });
+    }
+    alpha = split_point.alpha;
+    best_move = split_point.best_move;
+    METRIC_INC(split_points);
+    METRIC_ADD(split_helper_moves, split_point.helper_moves);
+  }
+
+  // Whether this is a helper whose search should be abandoned, a searcher in
+  // an aborted split point, or the main searcher out of time. The values
+  // returned by the search after that are meaningless, so they must not be
+  // stored in the TT.
+  inline bool IsStopped() const {
+    return out_of_time_ || stop_->load(std::memory_order_relaxed) ||
+           (split_abort_ != nullptr &&
+            split_abort_->load(std::memory_order_relaxed));
+  }
+
   // Evaluates situation `sit_` with the Negamax algorithm, exploring `depth`
-  // moves ahead. Higher is better for the player to move.
-  int NegamaxEval(int depth, int alpha, int beta) {
+  // moves ahead. `ply` is the distance from the root of the search, and
+  // `prev_move` is the move that led to `sit_`, or `NullMove()` at the root.
+  // Higher is better for the player to move.
+  int NegamaxEval(int depth, int ply, int alpha, int beta, Move prev_move) {
+    if (IsStopped()) return 0;
+    METRIC_INC(nodes);
+    // With late move reductions, ID iterations get deep enough that the search
+    // of a single root move can take much longer than the time left, so the
+    // time is also checked within it, after the first ID iteration.
+    if (!is_helper_ && ID_depth > 1 &&
+        ++nodes_since_time_check_ >= kTimeCheckNodes) {
+      nodes_since_time_check_ = 0;
+      if (MillisSince(search_start_timestamp) > search_millis) {
+        std::cout << "Did not finish search at depth " << ID_depth << std::endl;
+        root_search_aborted_ = true;
+        out_of_time_ = true;
+        return 0;
+      }
+    }
     if (sit_.IsGameOver()) {
       METRIC_INC(num_exits[depth][GAME_OVER_EXIT]);
-      // Adding `depth` to winning positions makes the AI choose moves that
-      // win faster. Subtracting `depth` from losing positions makes the AI
-      // choose moves that take the longest to lose.
+      // Subtracting `ply` from winning positions makes the AI choose moves
+      // that win faster. Adding `ply` to losing positions makes the AI choose
+      // moves that take the longest to lose. Unlike the remaining depth, the
+      // ply does not depend on the ID iteration.
       int winner = sit_.Winner();
       if (winner == 2) return 0;  // Draw.
-      return winner == sit_.turn ? kGameOverEval + depth
-                                 : -kGameOverEval - depth;
+      return winner == sit_.turn ? kGameOverEval + kMaxDepth - ply
+                                 : -kGameOverEval - kMaxDepth + ply;
     }
     if (depth == 0) {
       METRIC_INC(num_exits[depth][LEAF_EVAL_EXIT]);
@@ -94,13 +674,34 @@ class Negamax {
 
     // Read from TT.
     int starting_alpha = alpha;
-    std::size_t tt_location = TT.Location(sit_);
-    TTEntry<R, C>& tt_entry = TT.Entry(tt_location);
-    bool found_tt_entry = TT.Contains(tt_location, sit_);
-    if (found_tt_entry && tt_entry.depth >= depth) {
+    TTEntry tt_entry;
+    const TranspositionTable<R, C>* tt_table = ProbeTT(tt_entry, ply);
+    bool found_tt_entry = tt_table != nullptr;
+    METRIC_INC(tt_probes);
+    if (found_tt_entry) {
+      METRIC_INC(tt_hits);
+    }
+    if (tt_table == &hot_TT) {
+      METRIC_INC(tt_hot_hits);
+    }
+    // At the root, the entry must also provide the move to play, so only an
+    // exact entry with a legal move is used. Its move is not legal after a key
+    // collision, or if a helper stored the entry without a best move. Bound
+    // entries are not used either, because a cutoff would leave no move, and a
+    // narrowed window would change which side the root fails on. In all these
+    // cases, the root is searched normally.
+    if (found_tt_entry &&
+        (tt_entry.depth >= depth || IsDecidedTTEntry(tt_entry)) &&
+        (ply > 0 || (tt_entry.alpha_beta_flag == kExactFlag &&
+                     sit_.IsLegalMove(tt_entry.BestMove())))) {
+      if (tt_entry.depth < depth) {
+        METRIC_INC(tt_decided_reads[depth]);
+      }
       assert(tt_entry.alpha_beta_flag != kEmptyEntry);
       if (tt_entry.alpha_beta_flag == kExactFlag) {
         METRIC_INC(num_exits[depth][TT_HIT_EXIT]);
+        // The entry may have been stored by a helper.
+        if (ply == 0) root_result_ = {tt_entry.BestMove(), tt_entry.eval};
         return tt_entry.eval;
       } else if (tt_entry.alpha_beta_flag == kLowerboundFlag) {
         if (tt_entry.eval > alpha) {
@@ -124,6 +725,7 @@ class Negamax {
     }
 
     ScoredMove best_move;
+    best_move.move = NullMove();
     // `best_move_eval` is initialized to -2*kGameOverEval so that *some* move
     // is still chosen in the event that every move is losing, which are
     // evaluated to -kGameOverEval.
@@ -131,17 +733,27 @@ class Negamax {
 
     // Before generating moves, try the cached move, if any. This can cause an
     // instant cut-off or improve the alpha.
-    Move cached_move{tt_entry.token_change, {tt_entry.edge0, tt_entry.edge1}};
-    if (found_tt_entry && sit_.IsLegalMove(cached_move)) {
+    Move cached_move = found_tt_entry ? tt_entry.BestMove() : NullMove();
+    bool is_cached_move_legal = false;
+    if (cached_move != NullMove()) {
+      is_cached_move_legal = sit_.IsLegalMove(cached_move);
+      // The move stored for this situation is always legal, so the entry must
+      // belong to a different situation with the same key.
+      if (!is_cached_move_legal) {
+        METRIC_INC(tt_collision_reads[depth]);
+      }
+    }
+    if (is_cached_move_legal) {
       best_move.move = cached_move;
-      sit_.ApplyMove(cached_move);
-      int eval = -NegamaxEval(depth - 1, -beta, -alpha);
-      sit_.UndoMove(cached_move);
+      int eval = SearchChild(cached_move, depth, ply, alpha, beta, true);
+      if (IsStopped()) return 0;
       alpha = std::max(alpha, eval);
       // METRIC_INC(num_exits[depth][LEAF_EVAL_EXIT]);
       if (alpha >= beta) {
-        UpdateTTEntry(found_tt_entry, tt_location, tt_entry, depth, cached_move,
-                      eval, starting_alpha, beta);
+        METRIC_INC(beta_cutoffs);
+        UpdateHistory(depth, cached_move);
+        UpdateCountermove(prev_move, cached_move);
+        UpdateTTEntry(depth, ply, cached_move, eval, starting_alpha, beta);
         return eval;
       } else {
         best_move.move = cached_move;
@@ -153,13 +765,16 @@ class Negamax {
     // beta-cutoff or improves alpha.
     Move double_walk_move = GetDoubleWalkMove();
     if (sit_.IsLegalMove(double_walk_move)) {
-      sit_.ApplyMove(double_walk_move);
-      int eval = -NegamaxEval(depth - 1, -beta, -alpha);
-      sit_.UndoMove(double_walk_move);
+      int eval = SearchChild(double_walk_move, depth, ply, alpha, beta,
+                             !is_cached_move_legal);
+      if (IsStopped()) return 0;
       alpha = std::max(alpha, eval);
       if (alpha >= beta) {
-        UpdateTTEntry(found_tt_entry, tt_location, tt_entry, depth,
-                      double_walk_move, eval, starting_alpha, beta);
+        METRIC_INC(beta_cutoffs);
+        UpdateHistory(depth, double_walk_move);
+        UpdateCountermove(prev_move, double_walk_move);
+        UpdateTTEntry(depth, ply, double_walk_move, eval, starting_alpha,
+                      beta);
         return eval;
       } else if (eval > best_move.score) {
         best_move.move = double_walk_move;
@@ -167,82 +782,596 @@ class Negamax {
       }
     }
 
-    const auto& ordered_moves = OrderedMoves(depth - 1);
+    // Before generating moves, try the moves that caused cutoffs in other
+    // situations at the same ply, and then the move that last caused a cutoff
+    // in reply to `prev_move` (the countermove slot). See `IsLegalKiller` for
+    // how their legality is checked.
+    std::array<Move, kMaxKillers + 1> killers;
+    for (int k = 0; k < num_killers_; ++k) killers[k] = killers_[ply][k];
+    killers[num_killers_] = GetCountermove(prev_move);
+    std::array<ScoredMove, kMaxKillers + 1> searched_killers;
+    int num_searched_killers = 0;
+    for (int k = 0; k <= num_killers_; ++k) {
+      const Move killer = killers[k];
+      const bool is_countermove = k == num_killers_;
+      if (killer == NullMove() || killer == double_walk_move ||
+          (is_cached_move_legal && killer == cached_move) ||
+          FindMove(searched_killers.data(), num_searched_killers, killer) !=
+              nullptr ||
+          !IsLegalKiller(killer)) {
+        continue;
+      }
+      if (is_countermove) {
+        METRIC_INC(countermove_searches);
+      } else {
+        METRIC_INC(killer_searches);
+      }
+      int eval = SearchChild(killer, depth, ply, alpha, beta,
+                             best_move.score == -2 * kGameOverEval);
+      if (IsStopped()) return 0;
+      searched_killers[num_searched_killers++] = {killer, eval};
+      if (eval > best_move.score) {
+        best_move = {killer, eval};
+        if (eval > alpha) {
+          alpha = eval;
+          if (alpha >= beta) {
+            if (is_countermove) {
+              METRIC_INC(countermove_cutoffs);
+            } else {
+              METRIC_INC(killer_cutoffs);
+            }
+            METRIC_INC(beta_cutoffs);
+            UpdateKillers(ply, killer);
+            UpdateHistory(depth, killer);
+            UpdateCountermove(prev_move, killer);
+            UpdateTTEntry(depth, ply, killer, eval, starting_alpha, beta);
+            return eval;
+          }
+        }
+      }
+    }
+
+    std::vector<ScoredMove>* cached_moves =
+        ply < kMoveListCachePlies ? CachedMoveList(depth) : nullptr;
+    const nonstd::span<const ScoredMove> ordered_moves =
+        cached_moves != nullptr
+            ? nonstd::span<const ScoredMove>(cached_moves->data(),
+                                             cached_moves->size())
+            : OrderedMoves(depth - 1);
     METRIC_ADD(generated_children[depth], ordered_moves.size());
-    for (const ScoredMove& scored_move : ordered_moves) {
+    const int num_moves = static_cast<int>(ordered_moves.size());
+    // The result of each move, to refine the order of a cached list.
+    std::vector<int> move_evals;
+    if (cached_moves != nullptr) move_evals.assign(num_moves, kUnsearchedMove);
+    // Children at depth 0 are leaves, which do not read the TT.
+    const int prefetch_distance = depth > 1 ? tt_prefetch_distance_ : 0;
+    for (int i = 0; i < std::min(prefetch_distance, num_moves); ++i) {
+      PrefetchChild(ordered_moves[i].move);
+    }
+    int num_searched_moves = 0;
+    for (int i = 0; i < num_moves; ++i) {
+      // Once the first child has been searched (every eval is higher than the
+      // initial score), the rest can be searched in parallel.
+      if (best_move.score > -2 * kGameOverEval && CanSplit(depth)) {
+        SplitSearch(depth, ply, alpha, beta, ordered_moves, i,
+                    num_searched_moves,
+                    cached_moves != nullptr ? &move_evals : nullptr,
+                    {searched_killers.data(),
+                     static_cast<size_t>(num_searched_killers)},
+                    best_move);
+        if (IsStopped()) return 0;
+        break;
+      }
+      const ScoredMove& scored_move = ordered_moves[i];
       const Move& move = scored_move.move;
+      const ScoredMove* killer =
+          FindMove(searched_killers.data(), num_searched_killers, move);
+      if (killer != nullptr) {
+        if (cached_moves != nullptr) move_evals[i] = killer->score;
+        continue;
+      }
+      // Give the memory access time to complete while searching the moves in
+      // between.
+      if (prefetch_distance > 0 && i + prefetch_distance < num_moves) {
+        PrefetchChild(ordered_moves[i + prefetch_distance].move);
+      }
 
       // If it's a move that we haven't validated yet, we need to check if it is
       // legal.
       if (scored_move.score == kPossiblyIllegalMoveScore &&
           !sit_.IsLegalMove(move)) {
+        if (cached_moves != nullptr) move_evals[i] = kIllegalMove;
         continue;
       }
 
-      sit_.ApplyMove(move);
-      int move_eval = -NegamaxEval(depth - 1, -beta, -alpha);
-      sit_.UndoMove(move);
-
-      if (move_eval > alpha) {
-        alpha = move_eval;
+      // Every eval is higher than the initial score, so the first child
+      // searched is the one that leaves it unchanged.
+      int move_eval =
+          SearchOrderedChild(scored_move, num_searched_moves++, depth, ply,
+                             alpha, beta,
+                             best_move.score == -2 * kGameOverEval,
+                             cached_moves != nullptr);
+      if (IsStopped()) return 0;
+      if (cached_moves != nullptr) move_evals[i] = move_eval;
+
+      // The score is fail-soft: if every move fails low, it is the best of
+      // their upper bounds rather than `-2 * kGameOverEval`, which would be
+      // stored as a (wrong) upper bound in the TT.
+      if (move_eval > best_move.score) {
         best_move.score = move_eval;
         best_move.move = move;
-        if (alpha >= beta) break;
+        if (move_eval > alpha) {
+          alpha = move_eval;
+          if (alpha >= beta) break;
+        }
       }
 
       // Only do this check at the shallowest level, and after the first ID
       // iteration. For the first ID iteration (depth 1) we want to finish to
-      // ensure we have at least a move.
-      if (ID_depth > 1 && depth == ID_depth &&
+      // ensure we have at least a move. Helpers search until they are stopped.
+      if (!is_helper_ && ID_depth > 1 && depth == ID_depth &&
           MillisSince(search_start_timestamp) > search_millis) {
         std::cout << "Did not finish search at depth " << ID_depth << std::endl;
+        root_search_aborted_ = true;
         break;
       }
     }
 
-    UpdateTTEntry(found_tt_entry, tt_location, tt_entry, depth, best_move.move,
-                  best_move.score, starting_alpha, beta);
+    if (alpha >= beta) {
+      METRIC_INC(beta_cutoffs);
+      UpdateKillers(ply, best_move.move);
+      UpdateHistory(depth, best_move.move);
+      UpdateCountermove(prev_move, best_move.move);
+    }
+    if (cached_moves != nullptr) RefineMoveList(*cached_moves, move_evals);
+    UpdateTTEntry(depth, ply, best_move.move, best_move.score, starting_alpha,
+                  beta);
     METRIC_INC(num_exits[depth][REC_EVAL_EXIT]);
     return best_move.score;
   }
 
-  inline void UpdateTTEntry(bool found_tt_entry, std::size_t tt_location,
-                            TTEntry<R, C>& tt_entry, int depth, Move move,
-                            int eval, int starting_alpha, int beta) {
-    // Update TT. Current policy: always update or replace.
-    if (!found_tt_entry) {
-      tt_entry.sit = sit_;
-      if (TT.IsEmpty(tt_location)) {
-        METRIC_INC(tt_add_writes[depth]);
+  // Returns the element of `moves`, of size `num_moves`, with move `move`, or
+  // nullptr.
+  static inline const ScoredMove* FindMove(const ScoredMove* moves,
+                                           int num_moves, Move move) {
+    for (int i = 0; i < num_moves; ++i) {
+      if (moves[i].move == move) return &moves[i];
+    }
+    return nullptr;
+  }
+
+  // Whether `move`, a killer or countermove that was legal in another
+  // situation, is legal in `sit_`. Most are not because one of their walls is
+  // built already, which is checked first. Then, walls that are not bridges,
+  // or two walls in different 2-edge-connected components, cannot cut a token
+  // from its goal, which the wall structure proves without graph traversals if
+  // it is cached for the walls of `sit_`. Otherwise, `Situation::IsLegalMove`
+  // does the traversals.
+  bool IsLegalKiller(Move move) {
+    if (!sit_.AreWallsBuildable(move)) return false;
+    METRIC_INC(killer_legality_checks);
+    const WallStructure* structure =
+        move.IsDoubleWalkMove() ? nullptr
+                                : structure_cache_.Find(sit_.GraphHash());
+    if (structure != nullptr) {
+      if (move.IsDoubleBuildMove()) {
+        const auto& components = structure->two_edge_connected_components;
+        const int edge0 = move.edges[0], edge1 = move.edges[1];
+        if (!structure->bridges[edge0] && !structure->bridges[edge1] &&
+            components[LowerEndpoint(edge0)] !=
+                components[LowerEndpoint(edge1)]) {
+          return true;
+        }
+      } else if (move.IsWalkAndBuildMove()) {
+        const int src = sit_.tokens[sit_.turn];
+        const int dst = src + move.token_change;
+        if (dst < 0 || dst >= NumNodes(R, C) ||
+            (!AreHorizontalNeighbors(C, src, dst) &&
+             !AreVerticalNeighbors(C, src, dst)) ||
+            !sit_.G.edges[EdgeBetweenNeighbors(R, C, src, dst)]) {
+          return false;
+        }
+        const int edge = move.edges[0] != -1 ? move.edges[0] : move.edges[1];
+        if (!structure->bridges[edge]) return true;
+      }
+    }
+    METRIC_INC(killer_legality_traversals);
+    return sit_.IsLegalMove(move);
+  }
+
+  // Makes `move`, which caused a cutoff at `ply`, the first killer move of
+  // `ply`. If it was not a killer move already, the last one is dropped.
+  inline void UpdateKillers(int ply, Move move) {
+    if (num_killers_ == 0) return;
+    std::array<Move, kMaxKillers>& killers = killers_[ply];
+    int k = 0;
+    while (k < kMaxKillers - 1 && killers[k] != move) ++k;
+    for (; k > 0; --k) killers[k] = killers[k - 1];
+    killers[0] = move;
+  }
+
+  void ClearHistory() {
+    for (auto& history : wall_history_) history.fill(0);
+    for (auto& history : walk_history_) history.fill(0);
+    max_history_ = 0;
+  }
+
+  // Credits the walls and the token change of `move`, which caused a cutoff in
+  // `sit_` at `depth`, in the history tables of the player to move. Cutoffs
+  // near the root prune larger subtrees, so they weigh more.
+  void UpdateHistory(int depth, Move move) {
+    if (history_weight_ == 0) return;
+    const int bonus = depth * depth;
+    const int turn = sit_.turn;
+    for (int edge : move.edges) {
+      if (edge == -1) continue;
+      wall_history_[turn][edge] += bonus;
+      max_history_ = std::max(max_history_, wall_history_[turn][edge]);
+    }
+    if (move.token_change != 0) {
+      int& history = walk_history_[turn][move.token_change + 2 * C];
+      history += bonus;
+      max_history_ = std::max(max_history_, history);
+    }
+    if (max_history_ > kMaxHistory) {
+      for (auto& history : wall_history_) {
+        for (int& entry : history) entry /= 2;
+      }
+      for (auto& history : walk_history_) {
+        for (int& entry : history) entry /= 2;
+      }
+      max_history_ /= 2;
+    }
+  }
+
+  void ClearCountermoves() {
+    for (auto& table : countermove_table_) {
+      table.fill({NullMove(), NullMove()});
+    }
+  }
+
+  // Returns the index of `move` in the countermove tables. Each move
+  // corresponds to a different key, which is hashed with a multiplicative
+  // hash, keeping some of its high bits.
+  static int CountermoveIndex(Move move) {
+    uint32_t key = static_cast<uint32_t>(
+        (move.edges[0] + 1) * (NumRealAndFakeEdges(R, C) + 1) +
+        (move.edges[1] + 1));
+    key = key * (4 * C + 1) + static_cast<uint32_t>(move.token_change + 2 * C);
+    return static_cast<int>((key * 0x9E3779B1u) >> 16) &
+           (kCountermoveTableSize - 1);
+  }
+
+  // Returns the countermove of `prev_move` for the player to move in `sit_`,
+  // or `NullMove()` if there is none.
+  Move GetCountermove(Move prev_move) const {
+    if (!countermoves_ || prev_move == NullMove()) return NullMove();
+    const Countermove& entry =
+        countermove_table_[sit_.turn][CountermoveIndex(prev_move)];
+    return entry.prev_move == prev_move ? entry.move : NullMove();
+  }
+
+  // Makes `move`, which caused a cutoff in `sit_`, the countermove of
+  // `prev_move`, the move that led to `sit_`.
+  void UpdateCountermove(Move prev_move, Move move) {
+    if (!countermoves_ || prev_move == NullMove()) return;
+    countermove_table_[sit_.turn][CountermoveIndex(prev_move)] = {prev_move,
+                                                                  move};
+  }
+
+  // Returns the bonus of `move` for the player to move in `sit_`, between 0
+  // and `history_weight_` for each of its walls and its token change, in
+  // proportion to their entries in the history tables.
+  int HistoryScore(Move move) const {
+    const int turn = sit_.turn;
+    long long history = 0;
+    for (int edge : move.edges) {
+      if (edge != -1) history += wall_history_[turn][edge];
+    }
+    if (move.token_change != 0) {
+      history += walk_history_[turn][move.token_change + 2 * C];
+    }
+    return static_cast<int>(history_weight_ * history / (max_history_ + 1));
+  }
+
+  // Returns the eval of the child of `sit_` reached with `move`, for the node
+  // `sit_` searched with `depth`, `ply`, `alpha` and `beta`. With PVS, only the
+  // first child of a node (`is_first_child`), which is expected to be the best
+  // one, is searched with the full window. The others are searched with a
+  // null window to prove that they are not better than `alpha`, which takes
+  // fewer nodes, and only searched again with the full window if they are.
+  int SearchChild(Move move, int depth, int ply, int alpha, int beta,
+                  bool is_first_child) {
+    // Without mirror symmetry, `sit_.mirror_hash` is not used, so it is left
+    // as that of the root.
+    sit_.ApplyMove(move, mirror_symmetry_);
+    int eval;
+    if (!pvs_ || is_first_child || beta - alpha <= 1) {
+      eval = -NegamaxEval(depth - 1, ply + 1, -beta, -alpha, move);
+    } else {
+      METRIC_INC(pvs_null_window_searches);
+      eval = -NegamaxEval(depth - 1, ply + 1, -alpha - 1, -alpha, move);
+      if (eval > alpha && eval < beta && !IsStopped()) {
+        METRIC_INC(pvs_re_searches[depth]);
+        eval = -NegamaxEval(depth - 1, ply + 1, -beta, -alpha, move);
+      }
+    }
+    sit_.UndoMove(move, mirror_symmetry_);
+    return eval;
+  }
+
+  // Like `SearchChild`, for a move of the ordered list of `sit_` after
+  // `num_searched_moves` other moves of the list were searched. Moves of the
+  // list that are skipped, like killers or illegal moves, are not counted. If
+  // it is a late move with a low score, it is first searched with a
+  // reduced depth (see `NegamaxOptions::lmr_reductions`) and a null window,
+  // and only searched with its full depth if it turns out to be better than
+  // `alpha`. The scores of cached lists (`is_cached_list`) are evals from the
+  // previous ID iteration, which are not comparable with the heuristic scores
+  // of `OrderedMoves`, so late moves of cached lists are reduced by their
+  // position alone.
+  int SearchOrderedChild(const ScoredMove& scored_move, int num_searched_moves,
+                         int depth, int ply, int alpha, int beta,
+                         bool is_first_child, bool is_cached_list) {
+    const int reduction = std::min(lmr_reductions_[depth], depth - 1);
+    if (reduction > 0 && !is_first_child &&
+        num_searched_moves >= lmr_min_moves_ &&
+        (is_cached_list || scored_move.score < lmr_score_threshold_)) {
+      METRIC_INC(lmr_searches[depth]);
+      int eval = SearchChild(scored_move.move, depth - reduction, ply, alpha,
+                             alpha + 1, true);
+      if (eval <= alpha || IsStopped()) return eval;
+      METRIC_INC(lmr_re_searches[depth]);
+    }
+    return SearchChild(scored_move.move, depth, ply, alpha, beta,
+                       is_first_child);
+  }
+
+  // Returns the cached move list of `sit_`, generating and caching it if it is
+  // not cached yet, or nullptr if it is not cached and the cache is full. The
+  // list is the output of `OrderedMoves`, reordered after each search of
+  // `sit_` (see `RefineMoveList`).
+  std::vector<ScoredMove>* CachedMoveList(int depth) {
+    auto it = move_list_cache_.find(sit_.hash);
+    if (it != move_list_cache_.end()) {
+      METRIC_INC(move_list_cache_hits);
+      return &it->second;
+    }
+    METRIC_INC(move_list_cache_misses);
+    if (static_cast<int>(move_list_cache_.size()) >= kMoveListCacheSize) {
+      return nullptr;
+    }
+    const auto& moves = OrderedMoves(depth - 1);
+    // References to the values of an `unordered_map` remain valid when other
+    // values are inserted, so lists of parent situations are not invalidated.
+    return &move_list_cache_
+                .emplace(sit_.hash,
+                         std::vector<ScoredMove>(moves.begin(), moves.end()))
+                .first->second;
+  }
+
+  // Values of `move_evals` in `RefineMoveList` for moves that were not
+  // searched. They are outside of the range of evals.
+  static constexpr int kUnsearchedMove = -3 * kGameOverEval;
+  static constexpr int kIllegalMove = -4 * kGameOverEval;
+
+  // Reorders a cached move list after a search, given the eval of each move.
+  // Searched moves go first, from best to worst, with their eval as the new
+  // score. Those are proven to be legal, so their score must not stay
+  // `kPossiblyIllegalMoveScore`. Unsearched moves (e.g., after a cutoff) keep
+  // their relative order and score, and illegal moves are removed.
+  static void RefineMoveList(std::vector<ScoredMove>& moves,
+                             const std::vector<int>& move_evals) {
+    std::vector<ScoredMove> searched_moves;
+    std::vector<ScoredMove> unsearched_moves;
+    for (size_t i = 0; i < moves.size(); ++i) {
+      if (move_evals[i] == kIllegalMove) continue;
+      if (move_evals[i] == kUnsearchedMove) {
+        unsearched_moves.push_back(moves[i]);
       } else {
-        METRIC_INC(tt_replace_writes[depth]);
+        searched_moves.push_back({moves[i].move, move_evals[i]});
       }
     }
+    std::stable_sort(searched_moves.begin(), searched_moves.end(),
+                     [](const ScoredMove& lhs, const ScoredMove& rhs) {
+                       return lhs.score > rhs.score;
+                     });
+    moves = std::move(searched_moves);
+    moves.insert(moves.end(), unsearched_moves.begin(), unsearched_moves.end());
+  }
+
+  // Win and loss evals depend on the ply where the game ends (see
+  // `NegamaxEval`), so the TT stores them relative to the situation of the
+  // entry instead, which can be reached at any ply.
+  static inline int EvalToTT(int eval, int ply) {
+    if (eval >= kGameOverEval) return eval + ply;
+    if (eval <= -kGameOverEval) return eval - ply;
+    return eval;
+  }
+  static inline int EvalFromTT(int eval, int ply) {
+    if (eval >= kGameOverEval) return eval - ply;
+    if (eval <= -kGameOverEval) return eval + ply;
+    return eval;
+  }
+
+  // Whether the eval of an entry is a bound that proves a win or a loss, which
+  // holds at any depth since deeper searches cannot refute it.
+  static inline bool IsDecidedTTEntry(const TTEntry& entry) {
+    return (entry.eval >= kGameOverEval &&
+            entry.alpha_beta_flag != kUpperboundFlag) ||
+           (entry.eval <= -kGameOverEval &&
+            entry.alpha_beta_flag != kLowerboundFlag);
+  }
+
+  // With mirror symmetry, a situation and its mirror image are stored under
+  // the smaller of their hashes, and the entry is written from the point of
+  // view of the situation with that hash.
+  inline uint64_t TTHash(uint64_t hash, uint64_t mirror_hash) const {
+    return mirror_symmetry_ && mirror_hash < hash ? mirror_hash : hash;
+  }
+  inline bool IsTTEntryMirrored() const {
+    return mirror_symmetry_ && sit_.mirror_hash < sit_.hash;
+  }
+
+  // The situation whose point of view the TT entry of `sit_` is written from.
+  inline Situation<R, C> TTSituation() const {
+    return IsTTEntryMirrored() ? sit_.MirrorImage() : sit_;
+  }
+
+  // The table that stores the entries of nodes at `depth`.
+  inline TranspositionTable<R, C>& TableForDepth(int depth) {
+    return two_tier_tt_ && depth <= kHotTTMaxDepth ? hot_TT : TT;
+  }
+
+  // Returns the table where `sit_` is found, in which case its entry is copied
+  // to `entry`, with the best move for `sit_`, or nullptr if it is not in the
+  // TT. With a two-tier TT, the main table is consulted first because its
+  // entries are deeper.
+  inline const TranspositionTable<R, C>* ProbeTT(TTEntry& entry,
+                                                 int ply) const {
+    const uint64_t hash = TTHash(sit_.hash, sit_.mirror_hash);
+    const TranspositionTable<R, C>* table = &TT;
+    bool found = ProbeTable(TT, hash, entry);
+    if (!found && two_tier_tt_) {
+      table = &hot_TT;
+      found = ProbeTable(hot_TT, hash, entry);
+    }
+    if (!found) return nullptr;
+    if (IsTTEntryMirrored()) {
+      entry.SetBestMove(sit_.FromMirroredMove(entry.BestMove()));
+    }
+    entry.eval = static_cast<int16_t>(EvalFromTT(entry.eval, ply));
+    return table;
+  }
+
+  inline bool ProbeTable(const TranspositionTable<R, C>& table, uint64_t hash,
+                         TTEntry& entry) const {
+    if (kTTVerifyHits) {
+      const Situation<R, C> tt_sit = TTSituation();
+      return table.Probe(hash, entry, &tt_sit);
+    }
+    return table.Probe(hash, entry);
+  }
+
+  // The TT hash of the situation reached by applying `move` to `sit_`, which
+  // can be computed without applying the move.
+  inline uint64_t ChildTTHash(Move move) const {
+    if (!mirror_symmetry_) return sit_.hash ^ sit_.HashChangeOfMove(move);
+    return TTHash(sit_.hash ^ sit_.HashChangeOfMove(move),
+                  sit_.mirror_hash ^ sit_.MirrorHashChangeOfMove(move));
+  }
+
+  // Prefetches the TT bucket of the situation reached by applying `move` to
+  // `sit_`.
+  inline void PrefetchChild(Move move) const { TT.Prefetch(ChildTTHash(move)); }
 
+  inline void UpdateTTEntry(int depth, int ply, Move move, int eval,
+                            int starting_alpha, int beta) {
+    int8_t alpha_beta_flag;
     if (eval <= starting_alpha)
-      tt_entry.alpha_beta_flag = kUpperboundFlag;
+      alpha_beta_flag = kUpperboundFlag;
     else if (eval >= beta)
-      tt_entry.alpha_beta_flag = kLowerboundFlag;
+      alpha_beta_flag = kLowerboundFlag;
     else
-      tt_entry.alpha_beta_flag = kExactFlag;
+      alpha_beta_flag = kExactFlag;
+    if (ply == 0) root_result_ = {move, eval};
+
+    const Situation<R, C> tt_sit = kTTVerifyHits ? TTSituation() : sit_;
+    TTWrites write_type = TableForDepth(depth).Store(
+        TTHash(sit_.hash, sit_.mirror_hash), alpha_beta_flag,
+        static_cast<int8_t>(depth),
+        static_cast<int16_t>(EvalToTT(eval, ply)),
+        IsTTEntryMirrored() ? sit_.ToMirroredMove(move) : move,
+        kTTVerifyHits ? &tt_sit : nullptr);
+    if (write_type == ADD_WRITE) {
+      METRIC_INC(tt_add_writes[depth]);
+    } else if (write_type == REPLACE_WRITE) {
+      METRIC_INC(tt_replace_writes[depth]);
+    }
+  }
+
+  // Returns the distances from every node to each player's goal in `sit_.G`.
+  // Situations reached by different move orders, or differing only in the
+  // tokens, share walls, so the distances are cached by graph hash.
+  const GoalDistanceMaps& GoalDistances() {
+    const uint64_t graph_hash = sit_.GraphHash();
+    const GoalDistanceMaps* cached = distance_cache_.Find(graph_hash);
+    if (cached != nullptr) {
+      METRIC_INC(distance_cache_hits);
+      return *cached;
+    }
+    METRIC_INC(distance_cache_misses);
+    GoalDistanceMaps maps;
+    for (int player = 0; player < 2; ++player) {
+      const std::array<int, NumNodes(R, C)> distances =
+          sit_.G.Distances(Goals(R, C)[player]);
+      for (int node = 0; node < NumNodes(R, C); ++node) {
+        maps[player][node] = static_cast<DistanceType>(distances[node]);
+      }
+    }
+    return distance_cache_.Insert(graph_hash, maps);
+  }
+
+  // Returns the wall structure of `sit_.G`. Situations reached by walking
+  // without building walls share it, so it is cached by graph hash.
+  const WallStructure& GetWallStructure() {
+    const uint64_t graph_hash = sit_.GraphHash();
+    const WallStructure* cached = structure_cache_.Find(graph_hash);
+    if (cached != nullptr) {
+      METRIC_INC(structure_cache_hits);
+      return *cached;
+    }
+    METRIC_INC(structure_cache_misses);
+    WallStructure structure;
+    structure.bridges = sit_.G.Bridges();
+    const std::array<int, NumNodes(R, C)> components =
+        sit_.G.TwoEdgeConnectedComponents();
+    for (int node = 0; node < NumNodes(R, C); ++node) {
+      structure.two_edge_connected_components[node] =
+          static_cast<DistanceType>(components[node]);
+    }
+    return structure_cache_.Insert(graph_hash, structure);
+  }
 
-    tt_entry.depth = static_cast<int8_t>(depth);
-    tt_entry.eval = static_cast<int16_t>(eval);
-    tt_entry.token_change = static_cast<int8_t>(move.token_change);
-    tt_entry.edge0 = static_cast<int16_t>(move.edges[0]);
-    tt_entry.edge1 = static_cast<int16_t>(move.edges[1]);
+  // Returns the 2-edge-connected components of the graph `G_pruned` of
+  // `OrderedMoves`, given the `structure` of `sit_.G`, the connected
+  // components of `G_pruned`, and those of the tokens. The pruning only
+  // removes bridges and edges in dead zones, neither of which is in a cycle
+  // with the remaining edges. Thus, the 2-edge-connected components of
+  // `G_pruned` are those of `sit_.G`, except that each node in a dead zone
+  // becomes isolated. They are numbered in order of their lowest node, like
+  // `Graph::ConnectedComponents` does, so the labels (and the order of the
+  // moves) are the same as if they were computed from `G_pruned`.
+  static std::array<int, NumNodes(R, C)> PrunedTwoEdgeConnectedComponents(
+      const WallStructure& structure,
+      const std::array<int, NumNodes(R, C)>& connected_components,
+      const std::array<int, 2>& token_CCs) {
+    std::array<int, NumNodes(R, C)> two_edge_connected_components;
+    std::array<int, NumNodes(R, C)> new_labels;
+    new_labels.fill(-1);
+    int num_components = 0;
+    for (int node = 0; node < NumNodes(R, C); ++node) {
+      int cc = connected_components[node];
+      if (cc != token_CCs[0] && cc != token_CCs[1]) {
+        two_edge_connected_components[node] = num_components++;
+        continue;
+      }
+      int label = structure.two_edge_connected_components[node];
+      if (new_labels[label] == -1) new_labels[label] = num_components++;
+      two_edge_connected_components[node] = new_labels[label];
+    }
+    return two_edge_connected_components;
   }
 
   // Evaluates situation `sit_` with the formula dist(p1, g1) - dist(p0, g0).
   // Higher is better for P0.
-  inline int LeafEval() const {
-    return sit_.G.Distance(sit_.tokens[1], Goals(R, C)[1]) -
-           sit_.G.Distance(sit_.tokens[0], Goals(R, C)[0]);
+  inline int LeafEval() {
+    const GoalDistanceMaps& distances = GoalDistances();
+    return distances[1][sit_.tokens[1]] - distances[0][sit_.tokens[0]];
   }
 
   Move GetDoubleWalkMove() {
-    const std::array<int, NumNodes(R, C)> distances_from_goal =
-        sit_.G.Distances(Goals(R, C)[sit_.turn]);
+    const auto& distances_from_goal = GoalDistances()[sit_.turn];
     for (int node : sit_.G.NodesAtDistance2(sit_.tokens[sit_.turn])) {
       if (node == -1) continue;
       if (distances_from_goal[node] ==
@@ -261,16 +1390,14 @@ class Negamax {
   // the same `depth`.
   nonstd::span<const ScoredMove> OrderedMoves(int depth) {
     // The size is an upper bound on the number of possible
-    // moves. There is one thread_local array for each depth of the negamax
-    // search. The function returns a prefix of the array for the given `depth`
-    // as a span, so that no copies or allocations of the arrays need to happen.
-    thread_local std::array<std::array<ScoredMove, MaxNumLegalMoves(R, C)>,
-                            kMaxDepth>
-        move_lists_all_depths;
+    // moves. There is one array for each depth of the negamax search (see
+    // `move_lists_`). The function returns a prefix of the array for the given
+    // `depth` as a span, so that no copies or allocations of the arrays need to
+    // happen.
     // `moves` is a reference to the array for the given `depth`. We will place
     // the moves in a prefix of `moves`.
     std::array<ScoredMove, MaxNumLegalMoves(R, C)>& moves =
-        move_lists_all_depths[depth];
+        (*move_lists_)[depth];
     // `move_index` is the first unused index in `moves`. It will advance for
     // each move generated. The function will return a span of `moves` from
     // index 0 to index `move_index`.
@@ -289,7 +1416,8 @@ class Negamax {
         PathAsEdgeSet<R, C>(shortest_paths[0]),
         PathAsEdgeSet<R, C>(shortest_paths[1])};
 
-    const std::bitset<NumRealAndFakeEdges(R, C)> bridges = sit_.G.Bridges();
+    const WallStructure& structure = GetWallStructure();
+    const std::bitset<NumRealAndFakeEdges(R, C)>& bridges = structure.bridges;
 
     // A copy of the graph that we will modify, e.g., by pruning edges.
     Graph<R, C> G_pruned = sit_.G;
@@ -310,17 +1438,15 @@ class Negamax {
     // zone, they also do not have any reason to build a wall in one. Thus, we
     // remove walls in dead zones so that they are not considered during move
     // generation.
-    {
-      const std::array<int, NumNodes(R, C)> connected_components =
-          G_pruned.ConnectedComponents();
-      const std::array<int, 2> token_CCs{connected_components[tokens[0]],
-                                         connected_components[tokens[1]]};
-      for (int edge = 0; edge < NumRealAndFakeEdges(R, C); ++edge) {
-        // Take an arbitrary endpoint of the edge and check its CC.
-        int endpoint_cc = connected_components[LowerEndpoint(edge)];
-        if (endpoint_cc != token_CCs[0] && endpoint_cc != token_CCs[1]) {
-          G_pruned.DeactivateEdge(edge);
-        }
+    const std::array<int, NumNodes(R, C)> connected_components =
+        G_pruned.ConnectedComponents();
+    const std::array<int, 2> token_CCs{connected_components[tokens[0]],
+                                       connected_components[tokens[1]]};
+    for (int edge = 0; edge < NumRealAndFakeEdges(R, C); ++edge) {
+      // Take an arbitrary endpoint of the edge and check its CC.
+      int endpoint_cc = connected_components[LowerEndpoint(edge)];
+      if (endpoint_cc != token_CCs[0] && endpoint_cc != token_CCs[1]) {
+        G_pruned.DeactivateEdge(edge);
       }
     }
 
@@ -337,7 +1463,10 @@ class Negamax {
     edge_labels.fill(-2);
     {
       const std::array<int, NumNodes(R, C)> two_edge_connected_components =
-          G_pruned.TwoEdgeConnectedComponents();
+          PrunedTwoEdgeConnectedComponents(structure, connected_components,
+                                           token_CCs);
+      DBGS(assert(two_edge_connected_components ==
+                  G_pruned.TwoEdgeConnectedComponents()));
       for (int edge = 0; edge < NumRealAndFakeEdges(R, C); ++edge) {
         if (bridges[edge])
           edge_labels[edge] = -1;
@@ -642,6 +1771,15 @@ class Negamax {
       }
     }
 
+    // Add the history bonus of each move. Moves that may be illegal keep their
+    // score, which marks them as unchecked.
+    if (history_weight_ > 0 && max_history_ > 0) {
+      for (int i = 0; i < move_index; ++i) {
+        if (moves[i].score == kPossiblyIllegalMoveScore) continue;
+        moves[i].score += HistoryScore(moves[i].move);
+      }
+    }
+
     // Sort the moves from largest to smallest score.
     // Todo: maybe bucket sort is faster?
     std::sort(moves.begin(), moves.begin() + move_index,
@@ -687,10 +1825,6 @@ class Negamax {
     return {x, y};
   }
 
-  Move MoveInTTEntry(const TTEntry<R, C>& entry) {
-    return {entry.token_change, {entry.edge0, entry.edge1}};
-  }
-
   friend class Benchmark;
   friend class Tests;
 };
@@ -4,6 +4,7 @@
 #include <array>
 #include <bitset>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <ostream>
@@ -13,6 +14,7 @@
 #include "graph.h"
 #include "macro_utils.h"
 #include "move.h"
+#include "zobrist.h"
 
 namespace wallwars {
 
@@ -40,6 +42,18 @@ struct Situation {
   std::array<int8_t, 2> tokens;
   int8_t turn = 0;  // Index of the player to move; 0 or 1.
   Graph<R, C> G;
+  // Zobrist hash of `tokens`, `turn`, and `G`. It is updated incrementally by
+  // `ApplyMove` and `UndoMove`. Code that modifies the other fields directly
+  // must call `RecomputeHash` afterwards.
+  uint64_t hash;
+  // Zobrist hash of the mirror image of the situation: the board reflected
+  // across its vertical axis with the players swapped, which also swaps the
+  // turn. Since the start and goal of each player are the reflections of the
+  // other player's, the mirror image is strategically equivalent, except for
+  // the draw rule, which only favors P1. It is maintained like `hash`, unless
+  // `ApplyMove` and `UndoMove` are told not to, in which case it keeps the
+  // value it had before the moves.
+  uint64_t mirror_hash;
 
   // No constructor so that a Situation is a POD. This should make it easier to
   // initialize the transposition table, which can contain 100's of millions of
@@ -52,6 +66,45 @@ struct Situation {
               static_cast<int8_t>(Starts(C)[1])};
     turn = 0;
     G.SetStartingGraph();
+    RecomputeHash();
+  }
+
+  // Returns the Zobrist hash of the situation computed from scratch.
+  uint64_t ComputeHash() const {
+    const ZobristKeys<R, C>& keys = kZobristKeys<R, C>;
+    uint64_t res = keys.tokens[0][tokens[0]] ^ keys.tokens[1][tokens[1]];
+    if (turn == 1) res ^= keys.turn;
+    for (int edge = 0; edge < NumRealAndFakeEdges(R, C); ++edge) {
+      if (!G.edges[edge]) res ^= keys.edges[edge];
+    }
+    return res;
+  }
+
+  // Returns the Zobrist hash of the mirror image of the situation computed from
+  // scratch.
+  uint64_t ComputeMirrorHash() const {
+    const ZobristKeys<R, C>& keys = kZobristKeys<R, C>;
+    uint64_t res = keys.tokens[1][MirroredNode(C, tokens[0])] ^
+                   keys.tokens[0][MirroredNode(C, tokens[1])];
+    if (turn == 0) res ^= keys.turn;
+    for (int edge = 0; edge < NumRealAndFakeEdges(R, C); ++edge) {
+      if (!G.edges[edge]) res ^= keys.edges[MirroredEdge(C, edge)];
+    }
+    return res;
+  }
+
+  inline void RecomputeHash() {
+    hash = ComputeHash();
+    mirror_hash = ComputeMirrorHash();
+  }
+
+  // Returns the part of `hash` that only depends on the walls, so situations
+  // with the same walls but different tokens or turn have the same graph hash.
+  inline uint64_t GraphHash() const {
+    const ZobristKeys<R, C>& keys = kZobristKeys<R, C>;
+    uint64_t res = hash ^ keys.tokens[0][tokens[0]] ^ keys.tokens[1][tokens[1]];
+    if (turn == 1) res ^= keys.turn;
+    return res;
   }
 
   // Initializes `this` Situation by applying a string `s` representing a valid
@@ -85,8 +138,82 @@ struct Situation {
 
   inline void FlipTurn() { turn = (turn == 0) ? 1 : 0; }
 
-  void ApplyMove(Move move) {
+  // Returns the value that `hash` is XORed with when applying `move` to this
+  // situation. XORing it again undoes the move.
+  inline uint64_t HashChangeOfMove(Move move) const {
+    const ZobristKeys<R, C>& keys = kZobristKeys<R, C>;
+    uint64_t change = keys.turn;
+    for (int edge : move.edges) {
+      if (edge != -1) change ^= keys.edges[edge];
+    }
+    if (move.token_change != 0) {
+      change ^= keys.tokens[turn][tokens[turn]] ^
+                keys.tokens[turn][tokens[turn] + move.token_change];
+    }
+    return change;
+  }
+
+  // Returns the value that `mirror_hash` is XORed with when applying `move` to
+  // this situation.
+  inline uint64_t MirrorHashChangeOfMove(Move move) const {
+    const ZobristKeys<R, C>& keys = kZobristKeys<R, C>;
+    uint64_t change = keys.turn;
+    for (int edge : move.edges) {
+      if (edge != -1) change ^= keys.edges[MirroredEdge(C, edge)];
+    }
+    if (move.token_change != 0) {
+      const int mirror_turn = turn == 0 ? 1 : 0;
+      change ^=
+          keys.tokens[mirror_turn][MirroredNode(C, tokens[turn])] ^
+          keys.tokens[mirror_turn][MirroredNode(C, tokens[turn] +
+                                                       move.token_change)];
+    }
+    return change;
+  }
+
+  // Returns the mirror image of the situation (see `mirror_hash`).
+  Situation MirrorImage() const {
+    Situation res = *this;
+    for (int edge = 0; edge < NumRealAndFakeEdges(R, C); ++edge) {
+      res.G.edges[edge] = G.edges[MirroredEdge(C, edge)];
+    }
+    res.tokens = {static_cast<int8_t>(MirroredNode(C, tokens[1])),
+                  static_cast<int8_t>(MirroredNode(C, tokens[0]))};
+    res.FlipTurn();
+    res.RecomputeHash();
+    return res;
+  }
+
+  // Returns the reflection of `move` when it is made by a token at
+  // `mover_node`.
+  static Move MirroredMove(Move move, int mover_node) {
+    Move res = move;
+    for (int& edge : res.edges) {
+      if (edge != -1) edge = MirroredEdge(C, edge);
+    }
+    res.token_change = MirroredNode(C, mover_node + move.token_change) -
+                       MirroredNode(C, mover_node);
+    return res;
+  }
+
+  // Returns the move in the mirror image of this situation that corresponds
+  // to `move` in this situation.
+  inline Move ToMirroredMove(Move move) const {
+    return MirroredMove(move, tokens[turn]);
+  }
+
+  // Inverse of `ToMirroredMove`: returns the move in this situation that
+  // corresponds to `mirrored_move` in the mirror image.
+  inline Move FromMirroredMove(Move mirrored_move) const {
+    return MirroredMove(mirrored_move, MirroredNode(C, tokens[turn]));
+  }
+
+  // Searches that do not use `mirror_hash` skip its update
+  // (`update_mirror_hash`), which costs about as much as that of `hash`.
+  void ApplyMove(Move move, bool update_mirror_hash = true) {
     DBGS(CrashIfMoveIsIllegal(move));
+    hash ^= HashChangeOfMove(move);
+    if (update_mirror_hash) mirror_hash ^= MirrorHashChangeOfMove(move);
     for (int edge : move.edges) {
       if (edge != -1) {
         G.DeactivateEdge(edge);
@@ -94,8 +221,10 @@ struct Situation {
     }
     tokens[turn] = static_cast<int8_t>(tokens[turn] + move.token_change);
     FlipTurn();
+    DBGS(assert(hash == ComputeHash()));
+    DBGS(assert(!update_mirror_hash || mirror_hash == ComputeMirrorHash()));
   }
-  void UndoMove(Move move) {
+  void UndoMove(Move move, bool update_mirror_hash = true) {
     FlipTurn();
     for (int edge : move.edges) {
       if (edge != -1) {
@@ -104,6 +233,10 @@ struct Situation {
       }
     }
     tokens[turn] = static_cast<int8_t>(tokens[turn] - move.token_change);
+    hash ^= HashChangeOfMove(move);
+    if (update_mirror_hash) mirror_hash ^= MirrorHashChangeOfMove(move);
+    DBGS(assert(hash == ComputeHash()));
+    DBGS(assert(!update_mirror_hash || mirror_hash == ComputeMirrorHash()));
     DBGS(CrashIfMoveIsIllegal(move));
   }
 
@@ -134,7 +267,9 @@ struct Situation {
     bool players_can_reach_goals = clone.CanPlayersReachGoals();
     return players_can_reach_goals;
   }
-  bool IsLegalMove(Move move) const {
+  // Whether the walls of `move` are different real edges that are not built
+  // yet. Unlike the rest of `IsLegalMove`, it does not traverse the graph.
+  bool AreWallsBuildable(Move move) const {
     // Check that walls are not the same.
     if (move.edges[0] != -1 && move.edges[0] == move.edges[1]) return false;
     // Check that walls are not fake or already present.
@@ -142,6 +277,10 @@ struct Situation {
       if (edge == -1) continue;
       if (!IsRealEdge(R, C, edge) || !G.edges[edge]) return false;
     }
+    return true;
+  }
+  bool IsLegalMove(Move move) const {
+    if (!AreWallsBuildable(move)) return false;
     // Check that there is the correct number of actions.
     int src = tokens[turn];
     int dst = src + move.token_change;
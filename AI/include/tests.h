@@ -1,7 +1,11 @@
 #ifndef TESTS_H_
 #define TESTS_H_
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -15,6 +19,7 @@
 #include "macro_utils.h"
 #include "negamax.h"
 #include "situation.h"
+#include "transposition_table.h"
 #include "utils.h"
 
 namespace wallwars {
@@ -74,10 +79,37 @@ class Tests {
 
     // Situation tests
     RUN_TEST(SituationIsLegalMoveTest);
+    RUN_TEST(SituationHashTest);
+    RUN_TEST(SituationMirrorTest);
+
+    // Transposition table tests
+    RUN_TEST(TranspositionTableReplacementTest);
+    RUN_TEST(TranspositionTableAgingTest);
+    RUN_TEST(TranspositionTableStatsTest);
+    RUN_TEST(TranspositionTableTornEntryTest);
+    RUN_TEST(TranspositionTableSaveLoadTest);
+    RUN_TEST(TableMemoryPoolTest);
 
     // Negamax tests
     RUN_TEST(NegamaxOrderedMovesTest);
     RUN_TEST(NegamaxGetMoveTest);
+    RUN_TEST(NegamaxTwoTierTTTest);
+    RUN_TEST(NegamaxParallelSearchTest);
+    RUN_TEST(NegamaxSearchWindowsTest);
+    RUN_TEST(NegamaxAspirationRootTTBoundTest);
+    RUN_TEST(NegamaxKillersTest);
+    RUN_TEST(NegamaxLegalKillerTest);
+    RUN_TEST(NegamaxHistoryTest);
+    RUN_TEST(NegamaxCountermovesTest);
+    RUN_TEST(NegamaxLateMoveReductionsTest);
+    RUN_TEST(NegamaxDecidedEvalTest);
+    RUN_TEST(NegamaxIllegalRootTTMoveTest);
+    RUN_TEST(NegamaxRootTTBoundTest);
+    RUN_TEST(NegamaxRefineMoveListTest);
+    RUN_TEST(NegamaxChildTTHashTest);
+    RUN_TEST(NegamaxDistanceCacheTest);
+    RUN_TEST(NegamaxMoveListCacheTest);
+    RUN_TEST(NegamaxWallStructureTest);
 
     std::cerr << std::endl
               << "===============================================" << std::endl
@@ -106,6 +138,23 @@ class Tests {
     return res;
   }
 
+  // A 4x4 situation where P0 has a single winning move, `ForcedWinMove()`,
+  // which the search finds at depth 3.
+  Situation<4, 4> ForcedWinSituation() {
+    Situation<4, 4> sit = StartingSituation<4, 4>();
+    sit.G.BuildFromString(
+        ". . . ."
+        " + + + "
+        ". . . ."
+        " + + + "
+        ". . . ."
+        " +-+-+ "
+        ". . . .");
+    sit.tokens = {12, 13};
+    return sit;
+  }
+  Move ForcedWinMove() { return WalkAndBuildMove(12, 13, 24); }
+
   // Given a vector of length <= `NumNodes(4,4)`, it converts it into an array
   // of length `NumNodes(4,4)`, extending it with -1's as necessary.
   std::array<int, NumNodes(4, 4)> ExtendWithMinus1(const std::vector<int>& v) {
@@ -771,6 +820,226 @@ class Tests {
     return true;
   }
 
+  bool SituationHashTest() {
+    Situation<4, 4> sit = StartingSituation<4, 4>();
+    const uint64_t starting_hash = sit.hash;
+    ASSERT_EQ(sit.hash, sit.ComputeHash());
+    std::vector<Move> moves = {DoubleWalkMove(0, 8), WalkAndBuildMove(3, 7, 0),
+                               DoubleBuildMove(10, 19)};
+    for (Move move : moves) {
+      sit.ApplyMove(move);
+      ASSERT_EQ(sit.hash, sit.ComputeHash());
+    }
+    // Same walls and tokens but a different turn.
+    Situation<4, 4> other_turn = sit;
+    other_turn.FlipTurn();
+    other_turn.RecomputeHash();
+    ASSERT_EQ((sit.hash != other_turn.hash), true);
+    for (int i = moves.size() - 1; i >= 0; --i) {
+      sit.UndoMove(moves[i]);
+      ASSERT_EQ(sit.hash, sit.ComputeHash());
+    }
+    ASSERT_EQ(sit.hash, starting_hash);
+    // The same situation reached by a different move order has the same hash.
+    Situation<4, 4> sit1 = ParseSituationOrCrash<4, 4>("1. a2> b1v 2. c2");
+    Situation<4, 4> sit2 = ParseSituationOrCrash<4, 4>("1. b1v a2> 2. c2");
+    ASSERT_EQ(sit1.hash, sit2.hash);
+    return true;
+  }
+
+  bool SituationMirrorTest() {
+    for (int edge = 0; edge < NumRealAndFakeEdges(4, 5); ++edge) {
+      ASSERT_EQ(MirroredEdge(5, MirroredEdge(5, edge)), edge);
+      ASSERT_EQ(IsRealEdge(4, 5, MirroredEdge(5, edge)),
+                IsRealEdge(4, 5, edge));
+    }
+    Situation<4, 5> sit = ParseSituationOrCrash<4, 5>("1. b2 2. d2 3. a4> b3v");
+    ASSERT_EQ(sit.mirror_hash, sit.ComputeMirrorHash());
+    Situation<4, 5> mirror = sit.MirrorImage();
+    ASSERT_EQ(mirror.hash, sit.mirror_hash);
+    ASSERT_EQ(mirror.mirror_hash, sit.hash);
+    // P1 is to move, at d2 (node 8).
+    std::vector<Move> moves = {DoubleWalkMove(8, 18), WalkAndBuildMove(8, 9, 1),
+                               DoubleBuildMove(4, 25)};
+    for (Move move : moves) {
+      ASSERT_EQ(sit.IsLegalMove(move), true);
+      Move mirrored_move = sit.ToMirroredMove(move);
+      ASSERT_EQ(mirror.IsLegalMove(mirrored_move), true);
+      ASSERT_EQ(sit.FromMirroredMove(mirrored_move), move);
+      sit.ApplyMove(move);
+      mirror.ApplyMove(mirrored_move);
+      ASSERT_EQ((mirror == sit.MirrorImage()), true);
+      ASSERT_EQ(mirror.hash, sit.mirror_hash);
+      sit.UndoMove(move);
+      mirror.UndoMove(mirrored_move);
+      // Without its update, the mirror hash keeps its value, and the hash is
+      // still maintained.
+      const uint64_t mirror_hash = sit.mirror_hash;
+      sit.ApplyMove(move, false);
+      ASSERT_EQ(sit.mirror_hash, mirror_hash);
+      ASSERT_EQ(sit.hash, sit.ComputeHash());
+      sit.UndoMove(move, false);
+      ASSERT_EQ(sit.mirror_hash, sit.ComputeMirrorHash());
+    }
+    return true;
+  }
+
+  bool TranspositionTableReplacementTest() {
+    TranspositionTable<4, 4> TT(1);
+    // Hashes that only differ in the high 32 bits go to the same bucket.
+    auto hash_with_key = [](uint64_t key) { return (key << 32) | 12345; };
+    Move move = DoubleWalkMove(0, 8);
+    TTEntry entry;
+    // Fill the depth-preferred entries.
+    ASSERT_EQ(TT.Store(hash_with_key(1), kExactFlag, 5, 0, move), ADD_WRITE);
+    ASSERT_EQ(TT.Store(hash_with_key(2), kExactFlag, 6, 0, move), ADD_WRITE);
+    ASSERT_EQ(TT.Store(hash_with_key(3), kExactFlag, 7, 0, move), ADD_WRITE);
+    // Shallow entries go to the replace-always entry.
+    ASSERT_EQ(TT.Store(hash_with_key(4), kExactFlag, 1, 0, move), ADD_WRITE);
+    ASSERT_EQ(TT.Store(hash_with_key(5), kExactFlag, 1, 0, move),
+              REPLACE_WRITE);
+    ASSERT_EQ(TT.Probe(hash_with_key(4), entry), false);
+    ASSERT_EQ(TT.Probe(hash_with_key(5), entry), true);
+    // Updating an entry does not move it.
+    ASSERT_EQ(TT.Store(hash_with_key(5), kLowerboundFlag, 2, 3, move),
+              UPDATE_WRITE);
+    ASSERT_EQ(TT.Probe(hash_with_key(5), entry), true);
+    ASSERT_EQ(static_cast<int>(entry.depth), 2);
+    ASSERT_EQ(entry.eval, 3);
+    // A deep entry evicts the shallowest depth-preferred entry.
+    ASSERT_EQ(TT.Store(hash_with_key(6), kExactFlag, 8, 0, move),
+              REPLACE_WRITE);
+    ASSERT_EQ(TT.Probe(hash_with_key(1), entry), false);
+    for (uint64_t key : {2, 3, 5, 6}) {
+      ASSERT_EQ(TT.Probe(hash_with_key(key), entry), true);
+      ASSERT_EQ(entry.BestMove(), move);
+    }
+    return true;
+  }
+
+  bool TranspositionTableAgingTest() {
+    TranspositionTable<4, 4> TT(1);
+    auto hash_with_key = [](uint64_t key) { return (key << 32) | 12345; };
+    Move move = DoubleWalkMove(0, 8);
+    TTEntry entry;
+    ASSERT_EQ(TT.Store(hash_with_key(1), kExactFlag, 7, 0, move), ADD_WRITE);
+    TT.NewSearch();
+    ASSERT_EQ(TT.Store(hash_with_key(2), kExactFlag, 6, 0, move), ADD_WRITE);
+    ASSERT_EQ(TT.Store(hash_with_key(3), kExactFlag, 6, 0, move), ADD_WRITE);
+    // Entries from earlier searches are still readable.
+    TT.NewSearch();
+    ASSERT_EQ(TT.Probe(hash_with_key(1), entry), true);
+    ASSERT_EQ(static_cast<int>(entry.depth), 7);
+    // The entry of depth 7 is two searches old, so it is worth less than the
+    // entries of depth 6 from the previous search.
+    ASSERT_EQ(TT.Store(hash_with_key(4), kExactFlag, 5, 0, move),
+              REPLACE_WRITE);
+    ASSERT_EQ(TT.Probe(hash_with_key(1), entry), false);
+    for (uint64_t key : {2, 3, 4}) {
+      ASSERT_EQ(TT.Probe(hash_with_key(key), entry), true);
+    }
+    // Updating an entry makes it current.
+    ASSERT_EQ(TT.Store(hash_with_key(2), kExactFlag, 6, 0, move),
+              UPDATE_WRITE);
+    ASSERT_EQ(TT.Probe(hash_with_key(2), entry), true);
+    ASSERT_EQ(static_cast<int>(entry.generation), 2);
+    return true;
+  }
+
+  bool TranspositionTableStatsTest() {
+    TranspositionTable<4, 4> TT(1);
+    // The hashes go to buckets 0 and 1, which are sampled.
+    TT.Store((uint64_t{1} << 32) | 0, kExactFlag, 3, 0, NullMove());
+    TT.NewSearch();
+    TT.Store((uint64_t{2} << 32) | 0, kExactFlag, 3, 0, NullMove());
+    TT.Store((uint64_t{3} << 32) | 1, kExactFlag, 5, 0, NullMove());
+    TT.Store((uint64_t{4} << 32) | 1, kLowerboundFlag, 5, 0, NullMove());
+    TTStats stats = TT.SampleStats(2);
+    ASSERT_EQ(stats.sampled_entries, 2 * kTTBucketSize);
+    ASSERT_EQ(stats.hashfull_permille, 4 * 1000 / (2 * kTTBucketSize));
+    ASSERT_EQ(stats.stale_permille, 1000 / (2 * kTTBucketSize));
+    ASSERT_EQ(stats.depth_permille[3], 2 * 1000 / (2 * kTTBucketSize));
+    ASSERT_EQ(stats.depth_permille[5], 2 * 1000 / (2 * kTTBucketSize));
+    ASSERT_EQ(stats.depth_permille[4], 0);
+    return true;
+  }
+
+  bool TranspositionTableTornEntryTest() {
+    TranspositionTable<4, 4> TT(1);
+    uint64_t hash1 = (uint64_t{1} << 32) | 12345;
+    uint64_t hash2 = (uint64_t{2} << 32) | 12345;
+    TT.Store(hash1, kExactFlag, 5, 10, Move{0, {1, 2}});
+    TTSlot& slot = TT.buckets_[TT.Location(hash1)].slots[0];
+    uint64_t check1 = slot.check.load();
+    TT.Store(hash1, kExactFlag, 6, 20, Move{0, {3, 4}});
+    // Simulate a thread storing the second entry while another one stored a
+    // different entry in the same slot, leaving the words of both writes.
+    uint64_t check2 = slot.check.load();
+    slot.check.store(check1);
+    TTEntry entry;
+    ASSERT_EQ(TT.Probe(hash1, entry), false);
+    slot.check.store(check2);
+    ASSERT_EQ(TT.Probe(hash1, entry), true);
+    ASSERT_EQ(entry.eval, 20);
+    ASSERT_EQ(TT.Probe(hash2, entry), false);
+    return true;
+  }
+
+  bool TranspositionTableSaveLoadTest() {
+    const std::string path = "tt_save_load_test.tmp";
+    TranspositionTable<4, 4> TT(1);
+    TT.Store(12345, kExactFlag, 5, 10, Move{0, {1, 2}});
+    TT.Store(67890, kLowerboundFlag, 3, -7, DoubleWalkMove(0, 8));
+    ASSERT_EQ(TT.Save(path), true);
+
+    TranspositionTable<4, 4> loaded_TT(2);
+    ASSERT_EQ(loaded_TT.Load(path), true);
+    ASSERT_EQ(loaded_TT.NumBuckets(), TT.NumBuckets());
+    TTEntry entry;
+    ASSERT_EQ(loaded_TT.Probe(12345, entry), true);
+    ASSERT_EQ(entry.eval, 10);
+    ASSERT_EQ(entry.BestMove(), (Move{0, {1, 2}}));
+    ASSERT_EQ(loaded_TT.Probe(67890, entry), true);
+    ASSERT_EQ(entry.alpha_beta_flag, kLowerboundFlag);
+    ASSERT_EQ(entry.BestMove(), DoubleWalkMove(0, 8));
+    ASSERT_EQ(loaded_TT.Probe(11111, entry), false);
+    // Stores go to the mapped memory, not to the file.
+    loaded_TT.Store(11111, kExactFlag, 1, 0, NullMove());
+    ASSERT_EQ(loaded_TT.Probe(11111, entry), true);
+    TranspositionTable<4, 4> reloaded_TT(1);
+    ASSERT_EQ(reloaded_TT.Load(path), true);
+    ASSERT_EQ(reloaded_TT.Probe(11111, entry), false);
+
+    // Tables for other dimensions are rejected.
+    std::cerr << "Expected error: ";
+    TranspositionTable<4, 5> other_TT(1);
+    ASSERT_EQ(other_TT.Load(path), false);
+    std::remove(path.c_str());
+    return true;
+  }
+
+  bool TableMemoryPoolTest() {
+    // A size that no table uses, so that the pool has no other block of it.
+    using tt_internal::TableMemory;
+    using tt_internal::TableMemoryPool;
+    const std::size_t bytes = 3 * tt_internal::kHugePageBytes;
+    TableMemoryPool& pool = TableMemoryPool::Instance();
+    TableMemory block = pool.Acquire(bytes);
+    std::memset(block.memory, 0xAB, bytes);
+    pool.Release(block);
+    // The released block is handed out again, cleared.
+    TableMemory reused_block = pool.Acquire(bytes);
+    ASSERT_EQ(reused_block.memory, block.memory);
+    ASSERT_EQ(reused_block.bytes, bytes);
+    const unsigned char* memory =
+        static_cast<const unsigned char*>(reused_block.memory);
+    ASSERT_EQ(std::count(memory, memory + bytes, 0),
+              static_cast<std::ptrdiff_t>(bytes));
+    pool.Release(reused_block);
+    pool.Trim();
+    return true;
+  }
+
   bool NegamaxOrderedMovesTest() {
     // Case where the player can do a double-token move or a single move and
     // build a wall in the edge just crossed.
@@ -1083,21 +1352,539 @@ class Tests {
       }
     }
     {
-      Situation<4, 4> sit = StartingSituation<4, 4>();
-      // There is only one winning move.
-      sit.G.BuildFromString(
-          ". . . ."
-          " + + + "
-          ". . . ."
-          " + + + "
-          ". . . ."
-          " +-+-+ "
-          ". . . .");
-      sit.tokens = {12, 13};
-      Move actual = negamaxer.GetMove(sit, 1000);
-      Move expected = WalkAndBuildMove(12, 13, 24);
-      ASSERT_EQ(actual, expected);
+      Move actual = negamaxer.GetMove(ForcedWinSituation(), 1000);
+      ASSERT_EQ(actual, ForcedWinMove());
+    }
+    return true;
+  }
+
+  bool NegamaxTwoTierTTTest() {
+    for (bool two_tier_tt : {false, true}) {
+      NegamaxOptions options;
+      options.tt_mb = 16;
+      options.two_tier_tt = two_tier_tt;
+      Negamax<4, 4> negamaxer(options);
+      // The winning move is found at depth 3, so the search stores entries
+      // both shallower and deeper than `kHotTTMaxDepth`. Only a two-tier TT
+      // reads shallow ones back from the hot table.
+      global_metrics = {};
+      Move actual = negamaxer.GetMove(ForcedWinSituation(), 1000);
+      ASSERT_EQ(actual, ForcedWinMove());
+      ASSERT_EQ((global_metrics.tt_hot_hits > 0), two_tier_tt);
+    }
+    return true;
+  }
+
+  bool NegamaxParallelSearchTest() {
+    Situation<4, 4> sit = ForcedWinSituation();
+    ScoredMove expected;
+    {
+      NegamaxOptions options;
+      options.tt_mb = 16;
+      Negamax<4, 4> negamaxer(options);
+      negamaxer.GetMove(sit, 1000);
+      expected = negamaxer.root_result_;
+      ASSERT_EQ(expected.move, ForcedWinMove());
+    }
+    for (bool split_points : {false, true}) {
+      NegamaxOptions options;
+      options.tt_mb = 16;
+      options.num_threads = 3;
+      options.split_points = split_points;
+      Negamax<4, 4> negamaxer(options);
+      ASSERT_EQ(negamaxer.helpers_.size(), 2u);
+      // The same result as a single thread. The second search starts new
+      // helper threads on the same TT.
+      for (int i = 0; i < 2; ++i) {
+        negamaxer.GetMove(sit, 1000);
+        ASSERT_EQ(negamaxer.root_result_.move, expected.move);
+        ASSERT_EQ(negamaxer.root_result_.score, expected.score);
+      }
+      // A search that runs out of time stops every thread on time, and the
+      // helpers take part in it.
+      Situation<4, 4> start = StartingSituation<4, 4>();
+      global_metrics = {};
+      const auto search_start = std::chrono::high_resolution_clock::now();
+      Move move = negamaxer.GetMove(start, 300);
+      ASSERT_EQ((MillisSince(search_start) < 1300), true);
+      ASSERT_EQ(start.IsLegalMove(move), true);
+      if (split_points) {
+        ASSERT_EQ((global_metrics.split_points > 0), true);
+        ASSERT_EQ((global_metrics.split_helper_moves > 0), true);
+      } else {
+        ASSERT_EQ((global_metrics.helper_nodes > 0), true);
+      }
+    }
+    return true;
+  }
+
+  bool NegamaxSearchWindowsTest() {
+    Situation<4, 4> sit = ForcedWinSituation();
+    // Null-window searches (PVS) and aspiration windows must not change the
+    // result of a search with full windows.
+    ScoredMove expected;
+    for (int pvs = 0; pvs < 2; ++pvs) {
+      for (int aspiration_window : {0, 1}) {
+        NegamaxOptions options;
+        options.tt_mb = 16;
+        options.pvs = pvs == 1;
+        options.aspiration_window = aspiration_window;
+        Negamax<4, 4> negamaxer(options);
+        global_metrics = {};
+        negamaxer.GetMove(sit, 1000);
+        // Only PVS searches children with null windows, and re-searches those
+        // that beat alpha.
+        ASSERT_EQ((global_metrics.pvs_null_window_searches > 0), (pvs == 1));
+        ASSERT_EQ((global_metrics.TotalPVSReSearches() > 0), (pvs == 1));
+        // The eval of the forced win is outside of the aspiration window
+        // around the eval two plies shallower.
+        ASSERT_EQ((global_metrics.TotalAspirationReSearches() > 0),
+                  (aspiration_window > 0));
+        if (pvs == 0 && aspiration_window == 0) {
+          expected = negamaxer.root_result_;
+        } else {
+          ASSERT_EQ(negamaxer.root_result_.move, expected.move);
+          ASSERT_EQ(negamaxer.root_result_.score, expected.score);
+        }
+      }
+    }
+    return true;
+  }
+
+  bool NegamaxAspirationRootTTBoundTest() {
+    Situation<4, 4> sit = ForcedWinSituation();
+    sit.RecomputeHash();
+    ScoredMove expected;
+    for (int aspiration_window : {0, 1}) {
+      NegamaxOptions options;
+      options.tt_mb = 16;
+      options.aspiration_window = aspiration_window;
+      Negamax<4, 4> negamaxer(options);
+      // A stale lower bound for the root, with a legal move that does not win.
+      // Fail-highs and fail-lows must be decided from the evals returned by
+      // the root searches, not from the bound or an older root result.
+      Move stale_move = sit.AllLegalMoves()[0];
+      ASSERT_EQ((stale_move == ForcedWinMove()), false);
+      negamaxer.TT.Store(negamaxer.TTHash(sit.hash, sit.mirror_hash),
+                         kLowerboundFlag, kMaxDepth, 1, stale_move);
+      negamaxer.GetMove(sit, 1000);
+      ASSERT_EQ(negamaxer.root_result_.move, ForcedWinMove());
+      if (aspiration_window == 0) {
+        expected = negamaxer.root_result_;
+      } else {
+        ASSERT_EQ(negamaxer.root_result_.score, expected.score);
+      }
+    }
+    return true;
+  }
+
+  bool NegamaxKillersTest() {
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    options.num_killers = kMaxKillers;
+    Negamax<4, 4> negamaxer(options);
+    const int ply = 3;
+    auto& killers = negamaxer.killers_[ply];
+    killers.fill(NullMove());
+    Move m1 = DoubleBuildMove(1, 3);
+    Move m2 = DoubleBuildMove(1, 5);
+    Move m3 = DoubleBuildMove(3, 5);
+    Move m4 = DoubleBuildMove(5, 7);
+    negamaxer.UpdateKillers(ply, m1);
+    negamaxer.UpdateKillers(ply, m2);
+    negamaxer.UpdateKillers(ply, m3);
+    ASSERT_EQ((killers == std::array<Move, kMaxKillers>{m3, m2, m1}), true);
+    // A killer that causes another cutoff moves to the front.
+    negamaxer.UpdateKillers(ply, m1);
+    ASSERT_EQ((killers == std::array<Move, kMaxKillers>{m1, m3, m2}), true);
+    negamaxer.UpdateKillers(ply, m1);
+    ASSERT_EQ((killers == std::array<Move, kMaxKillers>{m1, m3, m2}), true);
+    // A new one replaces the oldest.
+    negamaxer.UpdateKillers(ply, m4);
+    ASSERT_EQ((killers == std::array<Move, kMaxKillers>{m4, m1, m3}), true);
+    return true;
+  }
+
+  bool NegamaxLegalKillerTest() {
+    using N = Negamax<4, 5>;
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    // No walls, a row of walls with two gaps, which form a 2-edge cut, and one
+    // with a single gap, which is a bridge.
+    const std::vector<std::string> layouts = {
+        ". . . . ."
+        " + + + + "
+        ". . . . ."
+        " + + + + "
+        ". . . . ."
+        " + + + + "
+        ". . . . .",
+        ". . . . ."
+        " + + + + "
+        ". . . . ."
+        " +-+-+-+ "
+        ". . . . ."
+        " + + + + "
+        ". . . . .",
+        ". . . . ."
+        " + + + + "
+        ". . . . ."
+        "-+-+-+-+ "
+        ". . . . ."
+        " + + + + "
+        ". . . . ."};
+    std::vector<Situation<4, 5>> sits;
+    std::vector<Move> killers;
+    for (const std::string& layout : layouts) {
+      for (int turn = 0; turn < 2; ++turn) {
+        Situation<4, 5> sit = StartingSituation<4, 5>();
+        sit.G.BuildFromString(layout);
+        sit.turn = turn;
+        sit.RecomputeHash();
+        sits.push_back(sit);
+        for (Move move : sit.AllLegalMoves()) killers.push_back(move);
+      }
+    }
+    for (const Situation<4, 5>& sit : sits) {
+      N negamaxer(options);
+      negamaxer.sit_ = sit;
+      global_metrics = {};
+      // The first pass has no wall structure cached, and the second one does.
+      for (int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) negamaxer.GetWallStructure();
+        for (Move killer : killers) {
+          ASSERT_EQ(negamaxer.IsLegalKiller(killer), sit.IsLegalMove(killer));
+        }
+      }
+      ASSERT_EQ((global_metrics.killer_legality_traversals <
+                 global_metrics.killer_legality_checks),
+                true);
+    }
+    return true;
+  }
+
+  bool NegamaxHistoryTest() {
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    options.history_weight = 8;
+    Negamax<4, 4> negamaxer(options);
+    negamaxer.sit_ = StartingSituation<4, 4>();
+    negamaxer.ClearHistory();
+    Move m1 = WalkAndBuildMove(0, 1, 3);
+    Move m2 = DoubleBuildMove(3, 5);
+    Move m3 = DoubleBuildMove(7, 9);
+    ASSERT_EQ(negamaxer.HistoryScore(m1), 0);
+    negamaxer.UpdateHistory(4, m1);
+    // Edge 3 and the token change of `m1` have the largest entries.
+    ASSERT_EQ(negamaxer.HistoryScore(m1), 15);
+    ASSERT_EQ(negamaxer.HistoryScore(m2), 7);
+    ASSERT_EQ(negamaxer.HistoryScore(m3), 0);
+    // The tables are per player.
+    negamaxer.sit_.turn = 1;
+    ASSERT_EQ(negamaxer.HistoryScore(m2), 0);
+    // Entries are halved once one of them exceeds `kMaxHistory`.
+    for (int i = 0; i <= kMaxHistory; ++i) negamaxer.UpdateHistory(1, m3);
+    ASSERT_EQ(negamaxer.max_history_, kMaxHistory / 2);
+    ASSERT_EQ(negamaxer.HistoryScore(m3), 15);
+    return true;
+  }
+
+  bool NegamaxCountermovesTest() {
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    options.countermoves = true;
+    Negamax<4, 4> negamaxer(options);
+    negamaxer.sit_ = StartingSituation<4, 4>();
+    negamaxer.ClearCountermoves();
+    Move prev1 = WalkAndBuildMove(0, 1, 3);
+    Move prev2 = DoubleBuildMove(3, 5);
+    Move m1 = DoubleBuildMove(7, 9);
+    Move m2 = DoubleWalkMove(0, 2);
+    ASSERT_EQ(negamaxer.GetCountermove(prev1), NullMove());
+    negamaxer.UpdateCountermove(prev1, m1);
+    negamaxer.UpdateCountermove(prev2, m2);
+    ASSERT_EQ(negamaxer.GetCountermove(prev1), m1);
+    ASSERT_EQ(negamaxer.GetCountermove(prev2), m2);
+    // A newer cutoff replaces the countermove.
+    negamaxer.UpdateCountermove(prev1, m2);
+    ASSERT_EQ(negamaxer.GetCountermove(prev1), m2);
+    // Moves that only differ in their token change have different
+    // countermoves.
+    ASSERT_EQ(negamaxer.GetCountermove(WalkAndBuildMove(0, 4, 3)), NullMove());
+    // The tables are per player.
+    negamaxer.sit_.turn = 1;
+    ASSERT_EQ(negamaxer.GetCountermove(prev1), NullMove());
+    return true;
+  }
+
+  bool NegamaxLateMoveReductionsTest() {
+    {
+      NegamaxOptions options;
+      options.tt_mb = 1;
+      options.lmr_reductions = {0, 1, 2};
+      Negamax<4, 4> negamaxer(options);
+      ASSERT_EQ(negamaxer.lmr_reductions_[1], 1);
+      // The last reduction applies to larger depths.
+      ASSERT_EQ(negamaxer.lmr_reductions_[2], 2);
+      ASSERT_EQ(negamaxer.lmr_reductions_[kMaxDepth], 2);
+    }
+    {
+      NegamaxOptions options;
+      options.tt_mb = 1;
+      options.lmr_reductions = {};
+      Negamax<4, 4> negamaxer(options);
+      ASSERT_EQ(negamaxer.lmr_reductions_[kMaxDepth], 0);
+    }
+    // Reducing every move but the first one, the search still finds the same
+    // winning move as without reductions, which is searched again with its
+    // full depth once its reduced search beats alpha.
+    for (bool lmr : {false, true}) {
+      NegamaxOptions options;
+      options.tt_mb = 16;
+      options.lmr_reductions =
+          lmr ? std::vector<int>{0, 0, 1} : std::vector<int>{};
+      options.lmr_min_moves = 1;
+      options.lmr_score_threshold = 1000;
+      Negamax<4, 4> negamaxer(options);
+      global_metrics = {};
+      Move actual = negamaxer.GetMove(ForcedWinSituation(), 1000);
+      ASSERT_EQ(actual, ForcedWinMove());
+      ASSERT_EQ((global_metrics.TotalLMRSearches() > 0), lmr);
+    }
+    return true;
+  }
+
+  bool NegamaxIllegalRootTTMoveTest() {
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    Negamax<4, 4> negamaxer(options);
+    Situation<4, 4> sit = StartingSituation<4, 4>();
+    sit.RecomputeHash();
+    // An exact entry for the root without a best move, as if stored by a
+    // different situation with the same key. The search must not play it.
+    negamaxer.TT.Store(negamaxer.TTHash(sit.hash, sit.mirror_hash), kExactFlag,
+                       kMaxDepth, 0, NullMove());
+    Move move = negamaxer.GetMove(sit, 100);
+    ASSERT_EQ(sit.IsLegalMove(move), true);
+    return true;
+  }
+
+  bool NegamaxRootTTBoundTest() {
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    Negamax<4, 4> negamaxer(options);
+    Situation<4, 4> sit = StartingSituation<4, 4>();
+    sit.RecomputeHash();
+    negamaxer.sit_ = sit;
+    negamaxer.ID_depth = 1;
+    // A lower bound for the root above the window, with a legal move. Using it
+    // would cut off the root without choosing a move, so the root must be
+    // searched and its result must match the returned eval.
+    Move bound_move = sit.AllLegalMoves()[0];
+    negamaxer.TT.Store(negamaxer.TTHash(sit.hash, sit.mirror_hash),
+                       kLowerboundFlag, kMaxDepth, 500, bound_move);
+    negamaxer.root_result_ = {NullMove(), 12345};
+    int eval = negamaxer.NegamaxEval(3, 0, -1, 1, NullMove());
+    ASSERT_EQ(negamaxer.root_result_.score, eval);
+    ASSERT_EQ(sit.IsLegalMove(negamaxer.root_result_.move), true);
+    return true;
+  }
+
+  bool NegamaxDecidedEvalTest() {
+    using N = Negamax<4, 4>;
+    const int win_eval = N::kGameOverEval + kMaxDepth;
+    // A win 3 plies below a node at ply 2 is 3 plies below the same situation
+    // reached at ply 4.
+    {
+      int stored = N::EvalToTT(win_eval - 5, 2);
+      ASSERT_EQ(N::EvalFromTT(stored, 4), (win_eval - 7));
+    }
+    {
+      int stored = N::EvalToTT(-win_eval + 5, 2);
+      ASSERT_EQ(N::EvalFromTT(stored, 4), (-win_eval + 7));
+    }
+    // Other evals do not depend on the ply.
+    ASSERT_EQ(N::EvalFromTT(N::EvalToTT(7, 2), 4), 7);
+    ASSERT_EQ(N::EvalFromTT(N::EvalToTT(-7, 2), 4), -7);
+    // Only bounds that prove a win or a loss are decided.
+    TTEntry entry{};
+    entry.eval = static_cast<int16_t>(win_eval - 3);
+    entry.alpha_beta_flag = kExactFlag;
+    ASSERT_EQ(N::IsDecidedTTEntry(entry), true);
+    entry.alpha_beta_flag = kLowerboundFlag;
+    ASSERT_EQ(N::IsDecidedTTEntry(entry), true);
+    entry.alpha_beta_flag = kUpperboundFlag;
+    ASSERT_EQ(N::IsDecidedTTEntry(entry), false);
+    entry.eval = static_cast<int16_t>(-win_eval + 3);
+    ASSERT_EQ(N::IsDecidedTTEntry(entry), true);
+    entry.alpha_beta_flag = kLowerboundFlag;
+    ASSERT_EQ(N::IsDecidedTTEntry(entry), false);
+    entry.eval = 5;
+    entry.alpha_beta_flag = kExactFlag;
+    ASSERT_EQ(N::IsDecidedTTEntry(entry), false);
+    return true;
+  }
+
+  bool NegamaxRefineMoveListTest() {
+    using N = Negamax<4, 4>;
+    std::vector<ScoredMove> moves = {{DoubleBuildMove(0, 1), 14},
+                                     {DoubleBuildMove(0, 2), 7},
+                                     {DoubleBuildMove(0, 3), 1},
+                                     {DoubleBuildMove(0, 4), 0},
+                                     {DoubleBuildMove(0, 5), -5000}};
+    // The second move causes a cutoff, so the last two are not searched. The
+    // third move is illegal.
+    std::vector<int> move_evals = {-3, 8, N::kIllegalMove, N::kUnsearchedMove,
+                                   N::kUnsearchedMove};
+    N::RefineMoveList(moves, move_evals);
+    std::vector<ScoredMove> expected = {{DoubleBuildMove(0, 2), 8},
+                                        {DoubleBuildMove(0, 1), -3},
+                                        {DoubleBuildMove(0, 4), 0},
+                                        {DoubleBuildMove(0, 5), -5000}};
+    ASSERT_EQ(moves, expected);
+    return true;
+  }
+
+  bool NegamaxChildTTHashTest() {
+    // The hash of each child, used to prefetch its TT bucket, must be the one
+    // under which its entry is stored, with or without mirror symmetry.
+    for (bool mirror_symmetry : {false, true}) {
+      NegamaxOptions options;
+      options.tt_mb = 1;
+      options.mirror_symmetry = mirror_symmetry;
+      Negamax<4, 5> negamaxer(options);
+      negamaxer.sit_ = ParseSituationOrCrash<4, 5>("1. b2 2. d2 3. a4> b3v");
+      for (Move move : negamaxer.sit_.AllLegalMoves()) {
+        const uint64_t child_hash = negamaxer.ChildTTHash(move);
+        negamaxer.sit_.ApplyMove(move);
+        ASSERT_EQ(child_hash, negamaxer.TTHash(negamaxer.sit_.hash,
+                                               negamaxer.sit_.mirror_hash));
+        negamaxer.sit_.UndoMove(move);
+      }
+    }
+    return true;
+  }
+
+  bool NegamaxDistanceCacheTest() {
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    Negamax<4, 5> negamaxer(options);
+    Situation<4, 5>& sit = negamaxer.sit_;
+    sit = ParseSituationOrCrash<4, 5>("1. b2 2. d2 3. a4> b3v");
+    const std::vector<Move> moves = sit.AllLegalMoves();
+    global_metrics = {};
+    // The first pass fills the cache, and the second one finds most graphs in
+    // it. Either way, the distances must be those of a new BFS.
+    for (int pass = 0; pass < 2; ++pass) {
+      for (Move move : moves) {
+        sit.ApplyMove(move);
+        const auto& maps = negamaxer.GoalDistances();
+        for (int player = 0; player < 2; ++player) {
+          const std::array<int, NumNodes(4, 5)> distances =
+              sit.G.Distances(Goals(4, 5)[player]);
+          for (int node = 0; node < NumNodes(4, 5); ++node) {
+            ASSERT_EQ(static_cast<int>(maps[player][node]), distances[node]);
+          }
+        }
+        sit.UndoMove(move);
+      }
+    }
+    ASSERT_EQ((global_metrics.distance_cache_hits > 0), true);
+    return true;
+  }
+
+  bool NegamaxMoveListCacheTest() {
+    NegamaxOptions options;
+    options.tt_mb = 16;
+    Negamax<4, 4> negamaxer(options);
+    Situation<4, 4> sit = ForcedWinSituation();
+    ASSERT_EQ(negamaxer.GetMove(sit, 1000), ForcedWinMove());
+    // The list of the root stays cached after the search, refined by its last
+    // ID iteration: the winning move comes first, with its eval as its score,
+    // followed by the other searched moves from best to worst.
+    sit.RecomputeHash();
+    negamaxer.sit_ = sit;
+    global_metrics = {};
+    const std::vector<ScoredMove>* moves = negamaxer.CachedMoveList(0);
+    ASSERT_EQ(global_metrics.move_list_cache_hits, 1LL);
+    ASSERT_EQ(moves->front().move, ForcedWinMove());
+    const int game_over_eval = Negamax<4, 4>::kGameOverEval;
+    ASSERT_EQ((moves->front().score >= game_over_eval), true);
+    ASSERT_EQ((moves->size() > 1 && (*moves)[1].score < game_over_eval), true);
+    return true;
+  }
+
+  bool NegamaxWallStructureTest() {
+    using N = Negamax<4, 5>;
+    NegamaxOptions options;
+    options.tt_mb = 1;
+    N negamaxer(options);
+    Situation<4, 5>& sit = negamaxer.sit_;
+    sit = StartingSituation<4, 5>();
+    // Four cells in the middle that can only be entered through a bridge, so
+    // they become a dead zone.
+    sit.G.BuildFromString(
+        ". . . . ."
+        " + +-+-+ "
+        ". .|. . ."
+        " + + + + "
+        ". .|. .|."
+        " + +-+-+ "
+        ". . . . .");
+    sit.RecomputeHash();
+    const std::vector<Move> moves = sit.AllLegalMoves();
+    global_metrics = {};
+    int num_pruned_edges = 0;
+    // The first pass fills the cache, and the second one finds most wall
+    // structures in it.
+    for (int pass = 0; pass < 2; ++pass) {
+      for (Move move : moves) {
+        sit.ApplyMove(move);
+        const N::WallStructure& structure = negamaxer.GetWallStructure();
+        ASSERT_EQ(structure.bridges, sit.G.Bridges());
+        const std::array<int, NumNodes(4, 5)> components =
+            sit.G.TwoEdgeConnectedComponents();
+        for (int node = 0; node < NumNodes(4, 5); ++node) {
+          ASSERT_EQ(static_cast<int>(
+                        structure.two_edge_connected_components[node]),
+                    components[node]);
+        }
+        // Prune the graph like `OrderedMoves` does, and check that the
+        // components relabeled from the cached structure are those of the
+        // pruned graph, which `OrderedMoves` used to compute from scratch.
+        Graph<4, 5> G_pruned = sit.G;
+        std::array<std::bitset<NumRealAndFakeEdges(4, 5)>, 2> SP_edges;
+        for (int player = 0; player < 2; ++player) {
+          SP_edges[player] = PathAsEdgeSet<4, 5>(
+              sit.G.ShortestPath(sit.tokens[player], Goals(4, 5)[player]));
+        }
+        for (int edge = 0; edge < NumRealAndFakeEdges(4, 5); ++edge) {
+          if (structure.bridges[edge] && !SP_edges[0][edge] &&
+              !SP_edges[1][edge]) {
+            G_pruned.DeactivateEdge(edge);
+          }
+        }
+        const std::array<int, NumNodes(4, 5)> connected_components =
+            G_pruned.ConnectedComponents();
+        const std::array<int, 2> token_CCs{
+            connected_components[sit.tokens[0]],
+            connected_components[sit.tokens[1]]};
+        for (int edge = 0; edge < NumRealAndFakeEdges(4, 5); ++edge) {
+          const int cc = connected_components[LowerEndpoint(edge)];
+          if (cc != token_CCs[0] && cc != token_CCs[1] &&
+              G_pruned.edges[edge]) {
+            G_pruned.DeactivateEdge(edge);
+            ++num_pruned_edges;
+          }
+        }
+        ASSERT_EQ(N::PrunedTwoEdgeConnectedComponents(
+                      structure, connected_components, token_CCs),
+                  G_pruned.TwoEdgeConnectedComponents());
+        sit.UndoMove(move);
+      }
     }
+    ASSERT_EQ((num_pruned_edges > 0), true);
+    ASSERT_EQ((global_metrics.structure_cache_hits > 0), true);
     return true;
   }
 };
@@ -1,10 +1,30 @@
 #ifndef TRANSPOSITION_TABLE_H_
 #define TRANSPOSITION_TABLE_H_
 
+#include <algorithm>
 #include <array>
-#include <bitset>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
 #include <limits>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "benchmark_metrics.h"
 #include "constants.h"
 #include "graph.h"
 #include "move.h"
@@ -12,17 +32,19 @@
 
 namespace wallwars {
 
-// Use this flag corresponding to an invalid turn to indicate an invalid/empty
-// entry.
-constexpr int kEmptyFlag = -1;
-
-std::size_t kInvalidLocation = SIZE_MAX;
-
-// Todo: improve hash function.
+// The Zobrist hash maintained incrementally by the situation.
 template <int R, int C>
-std::size_t SituationHash(const Situation<R, C>& sit) {
-  return (sit.tokens[0] | (sit.tokens[1] << 16)) ^
-         std::hash<std::bitset<NumRealAndFakeEdges(R, C)>>{}(sit.G.edges);
+inline uint64_t SituationHash(const Situation<R, C>& sit) {
+  return sit.hash;
+}
+
+// The low bits of a hash determine the bucket of a situation in the TT, and
+// the high 32 bits are stored in the entry to tell apart situations that go to
+// the same bucket. Two different situations with the same bucket and key (a
+// collision) are indistinguishable. With 32-bit keys, this happens with
+// probability 2^-32 for each occupied entry checked in a probe.
+inline uint32_t VerificationKey(uint64_t hash) {
+  return static_cast<uint32_t>(hash >> 32);
 }
 
 // Alpha-beta flags.
@@ -31,72 +53,636 @@ constexpr int8_t kExactFlag = 1;
 constexpr int8_t kLowerboundFlag = 2;
 constexpr int8_t kUpperboundFlag = 3;
 
-template <int R, int C>
+// A TT entry does not store the situation itself, only its verification key,
+// which keeps entries small so that more of them fit in the table.
 struct TTEntry {
-  Situation<R, C> sit;
+  uint32_t key;
 
   // Eval of a position. Evals with absolute value up to 32767 are possible.
   int16_t eval;
 
-  // Best move found for this position.
+  // Best move found for this position, or the null move if none was found.
   int16_t edge0;
   int16_t edge1;
   int8_t token_change;
 
   // Whether the evaluation is exact, a lower bound, or an upper bound.
-  // See the flag constants in `negamaxer.cc`.
-  int8_t alpha_beta_flag = kEmptyEntry;
+  // See the flag constants above.
+  int8_t alpha_beta_flag;
 
   // Depth of the eval. Higher (shallower) depths are based on a longer
   // lookahead, so they can be used for lower depths too. Depths up to 127 are
   // possible.
   int8_t depth;
+
+  // The search that stored the entry (see `TranspositionTable::NewSearch`).
+  uint8_t generation;
+
+  inline Move BestMove() const { return {token_change, {edge0, edge1}}; }
+  inline void SetBestMove(Move move) {
+    token_change = static_cast<int8_t>(move.token_change);
+    edge0 = static_cast<int16_t>(move.edges[0]);
+    edge1 = static_cast<int16_t>(move.edges[1]);
+  }
+};
+static_assert(sizeof(TTEntry) == 16, "TT entries should fill 16 bytes");
+
+// Version of the layout of `TTEntry` and of its encoding in a `TTSlot`. It must
+// be increased whenever either changes, so that TT files saved with the old
+// layout are rejected.
+constexpr uint32_t kTTEntryLayoutVersion = 2;
+
+// The TT can be shared by threads searching in parallel without locks. Each
+// entry is stored as two 64-bit words that are read and written atomically, but
+// not together, so a reader can see the words of two different writes (a torn
+// entry). Following Hyatt's lockless hashing, the first word is stored XORed
+// with the second one. A torn entry decodes to a garbage key, so it is
+// detected like a key mismatch, except with probability 2^-32.
+struct TTSlot {
+  std::atomic<uint64_t> check;  // First word of the entry XOR `data`.
+  std::atomic<uint64_t> data;   // Second word of the entry.
+};
+static_assert(sizeof(TTSlot) == sizeof(TTEntry),
+              "TT slots should have the same size as TT entries");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "The TT needs lock-free 64-bit atomics");
+
+// The TT is organized in buckets of entries that fill a cache line, so that
+// looking up a situation touches a single cache line. A situation can be
+// stored in any entry of its bucket. The last entry of each bucket is
+// "replace-always": it takes any new entry that is not worth evicting one of
+// the other entries, which are "depth-preferred": they keep the entries with
+// the deepest searches.
+constexpr int kTTBucketBytes = 64;
+constexpr int kTTBucketSize = kTTBucketBytes / sizeof(TTSlot);
+constexpr int kTTReplaceAlwaysIndex = kTTBucketSize - 1;
+
+struct alignas(kTTBucketBytes) TTBucket {
+  std::array<TTSlot, kTTBucketSize> slots;
+};
+static_assert(sizeof(TTBucket) == kTTBucketBytes,
+              "TT buckets should fill a cache line");
+
+// Returns the number of buckets in a TT of `size_mb` mega bytes. It is the
+// largest power of two that fits, so that the bucket of a hash can be found
+// with a mask instead of a modulo.
+constexpr long long NumTTBuckets(long long size_mb) {
+  long long max_buckets = size_mb * 1024LL * 1024LL / sizeof(TTBucket);
+  long long num_buckets = 1;
+  while (num_buckets * 2 <= max_buckets) num_buckets *= 2;
+  return num_buckets;
+}
+
+constexpr long long NumTTEntries(long long size_mb) {
+  return NumTTBuckets(size_mb) * kTTBucketSize;
+}
+
+namespace tt_internal {
+
+// Huge pages reduce TLB misses when probing a large table at random.
+constexpr std::size_t kHugePageBytes = 2 * 1024 * 1024;
+
+// A block of memory that holds a table.
+struct TableMemory {
+  // Start of the table, aligned to `kHugePageBytes`, and size of the table.
+  void* memory = nullptr;
+  std::size_t bytes = 0;
+  // The underlying allocation, which may be larger to align `memory`.
+  void* allocation = nullptr;
+  std::size_t allocation_bytes = 0;
 };
 
+// Allocates `bytes` bytes of zeroed memory aligned to `kHugePageBytes`, and
+// asks the OS to back it with transparent huge pages when available. The
+// memory is reserved lazily by the OS, so this is fast even for large sizes.
+inline TableMemory AllocateTableMemory(std::size_t bytes) {
+  TableMemory block;
+  block.bytes = bytes;
+#if defined(__unix__) || defined(__APPLE__)
+  // Over-allocate to be able to align the start to a huge page.
+  block.allocation_bytes = bytes + kHugePageBytes;
+  block.allocation = mmap(nullptr, block.allocation_bytes,
+                          PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                          -1, 0);
+  if (block.allocation == MAP_FAILED) {
+    std::cerr << "Error: could not allocate " << bytes << " bytes for the TT"
+              << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  uintptr_t start = reinterpret_cast<uintptr_t>(block.allocation);
+  start = (start + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+  block.memory = reinterpret_cast<void*>(start);
+#ifdef MADV_HUGEPAGE
+  madvise(block.memory, bytes, MADV_HUGEPAGE);
+#endif
+#else
+  block.allocation_bytes = bytes;
+  block.allocation = ::operator new(bytes, std::align_val_t(kHugePageBytes));
+  block.memory = block.allocation;
+  std::memset(block.memory, 0, bytes);
+#endif
+  return block;
+}
+
+inline void FreeTableMemory(const TableMemory& block) {
+#if defined(__unix__) || defined(__APPLE__)
+  munmap(block.allocation, block.allocation_bytes);
+#else
+  ::operator delete(block.allocation, std::align_val_t(kHugePageBytes));
+#endif
+}
+
+// Zeroes a block. On Linux, the pages are discarded and the OS zeroes them
+// lazily on their next touch, which is much faster than writing them when a
+// large table is reused but only partially filled (e.g., a short search).
+// Otherwise, the block is zeroed with one thread per `kClearBytesPerThread`
+// bytes, up to the number of hardware threads.
+inline void ClearTableMemory(const TableMemory& block) {
+#ifdef __linux__
+  // Anonymous private pages read as zero after being discarded.
+  if (madvise(block.memory, block.bytes, MADV_DONTNEED) == 0) return;
+#endif
+  constexpr std::size_t kClearBytesPerThread = 64 * 1024 * 1024;
+  const std::size_t max_threads =
+      std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t num_threads =
+      std::clamp<std::size_t>(block.bytes / kClearBytesPerThread, 1,
+                              max_threads);
+  char* memory = static_cast<char*>(block.memory);
+  if (num_threads == 1) {
+    std::memset(memory, 0, block.bytes);
+    return;
+  }
+  const std::size_t chunk_bytes = block.bytes / num_threads;
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < num_threads; ++i) {
+    std::size_t begin = i * chunk_bytes;
+    std::size_t end = i + 1 == num_threads ? block.bytes : begin + chunk_bytes;
+    threads.emplace_back(
+        [memory, begin, end] { std::memset(memory + begin, 0, end - begin); });
+  }
+  for (std::thread& thread : threads) thread.join();
+}
+
+// Process-wide pool of table memory. The blocks of destroyed tables are kept
+// mapped and handed out, cleared, to new tables of the same size, e.g., the
+// tables of each sample in the benchmark or each game in interactive mode.
+// This saves the `mmap`, `munmap` and `madvise` calls of each table, which are
+// slow for large blocks. It does not save page faults: on Linux, clearing a
+// block discards its pages (see `ClearTableMemory`), so they are faulted in
+// again on their first touch, as in a fresh block.
+class TableMemoryPool {
+ public:
+  static TableMemoryPool& Instance() {
+    static TableMemoryPool pool;
+    return pool;
+  }
+
+  // Returns a zeroed block of `bytes` bytes.
+  TableMemory Acquire(std::size_t bytes) {
+    TableMemory block;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = std::find_if(
+          free_blocks_.begin(), free_blocks_.end(),
+          [bytes](const TableMemory& free) { return free.bytes == bytes; });
+      if (it == free_blocks_.end()) return AllocateTableMemory(bytes);
+      block = *it;
+      free_blocks_.erase(it);
+    }
+    ClearTableMemory(block);
+    return block;
+  }
+
+  // Returns a block obtained from `Acquire` to the pool.
+  void Release(const TableMemory& block) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_blocks_.push_back(block);
+  }
+
+  // Frees the blocks that are not in use.
+  void Trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const TableMemory& block : free_blocks_) FreeTableMemory(block);
+    free_blocks_.clear();
+  }
+
+  ~TableMemoryPool() { Trim(); }
+
+ private:
+  TableMemoryPool() = default;
+
+  std::mutex mutex_;
+  std::vector<TableMemory> free_blocks_;
+};
+
+// Concurrent accesses to slots only need to be atomic, not ordered: a stale
+// or torn entry is no worse than a missing one.
+inline TTEntry LoadEntry(const TTSlot& slot) {
+  uint64_t words[2];
+  words[1] = slot.data.load(std::memory_order_relaxed);
+  words[0] = slot.check.load(std::memory_order_relaxed) ^ words[1];
+  TTEntry entry;
+  std::memcpy(&entry, words, sizeof(entry));
+  return entry;
+}
+
+inline void StoreEntry(TTSlot& slot, const TTEntry& entry) {
+  uint64_t words[2];
+  std::memcpy(words, &entry, sizeof(entry));
+  slot.check.store(words[0] ^ words[1], std::memory_order_relaxed);
+  slot.data.store(words[1], std::memory_order_relaxed);
+}
+
+// A TT file consists of this header, padded to `kTTFileHeaderBytes`, followed
+// by the buckets. The header describes everything that must match for the
+// saved entries to be meaningful: the board dimensions and the Zobrist keys
+// determine the hashes, and the layout determines how entries are decoded.
+struct TTFileHeader {
+  char magic[8];
+  uint32_t rows;
+  uint32_t columns;
+  uint32_t entry_layout_version;
+  uint32_t entry_bytes;
+  uint32_t bucket_size;
+  uint64_t zobrist_seed;
+  uint64_t num_buckets;
+  uint32_t generation;
+};
+
+constexpr char kTTFileMagic[8] = {'W', 'W', 'T', 'T', 'F', 'I', 'L', 'E'};
+
+// A multiple of the page size, so that the buckets can be mapped directly.
+constexpr std::size_t kTTFileHeaderBytes = 4096;
+static_assert(sizeof(TTFileHeader) <= kTTFileHeaderBytes,
+              "The TT file header should fit in its padding");
+
+// Returns whether `header` describes a TT for RxC boards that this program can
+// read. Otherwise, it prints the first mismatch.
 template <int R, int C>
-constexpr int NumTTEntries() {
-  long long size_bytes = kTranspositionTableMB * 1024LL * 1024LL;
-  return size_bytes / sizeof(TTEntry<R, C>);
+bool IsCompatibleTTFileHeader(const TTFileHeader& header,
+                              const std::string& path) {
+  auto mismatch = [&path](const std::string& field) {
+    std::cerr << "Error: TT file " << path << " has a different " << field
+              << std::endl;
+    return false;
+  };
+  if (std::memcmp(header.magic, kTTFileMagic, sizeof(kTTFileMagic)) != 0) {
+    std::cerr << "Error: " << path << " is not a TT file" << std::endl;
+    return false;
+  }
+  if (header.rows != R || header.columns != C) {
+    return mismatch("board size (" + std::to_string(header.rows) + "x" +
+                    std::to_string(header.columns) + ")");
+  }
+  if (header.entry_layout_version != kTTEntryLayoutVersion ||
+      header.entry_bytes != sizeof(TTEntry) ||
+      header.bucket_size != kTTBucketSize) {
+    return mismatch("entry layout");
+  }
+  if (header.zobrist_seed != kZobristSeed) return mismatch("hash seed");
+  if (header.num_buckets == 0 ||
+      (header.num_buckets & (header.num_buckets - 1)) != 0) {
+    return mismatch("number of buckets (not a power of two)");
+  }
+  return true;
 }
 
+}  // namespace tt_internal
+
 template <int R, int C>
 class TranspositionTable {
  public:
-  std::array<TTEntry<R, C>, NumTTEntries<R, C>()>* entries;
+  // The size is rounded down to a power of two number of buckets (see
+  // `NumTTBuckets`).
+  explicit TranspositionTable(long long size_mb = kTranspositionTableMB)
+      : num_buckets_(NumTTBuckets(size_mb)), bucket_mask_(num_buckets_ - 1) {
+    // Zeroed memory is a table of empty entries, since `kEmptyEntry` is 0.
+    memory_ = tt_internal::TableMemoryPool::Instance().Acquire(
+        num_buckets_ * sizeof(TTBucket));
+    buckets_ = static_cast<TTBucket*>(memory_.memory);
+    ResetSituations();
+  }
+  ~TranspositionTable() { ReleaseMemory(); }
+  TranspositionTable(const TranspositionTable&) = delete;
+  TranspositionTable& operator=(const TranspositionTable&) = delete;
 
-  TranspositionTable() {
-    entries = new std::array<TTEntry<R, C>, NumTTEntries<R, C>()>;
+  // Writes the table to the file at `path`, replacing it. Must not be called
+  // during a search. Returns whether it succeeded; otherwise, it prints the
+  // error.
+  bool Save(const std::string& path) const {
+    tt_internal::TTFileHeader header{};
+    std::memcpy(header.magic, tt_internal::kTTFileMagic,
+                sizeof(tt_internal::kTTFileMagic));
+    header.rows = R;
+    header.columns = C;
+    header.entry_layout_version = kTTEntryLayoutVersion;
+    header.entry_bytes = sizeof(TTEntry);
+    header.bucket_size = kTTBucketSize;
+    header.zobrist_seed = kZobristSeed;
+    header.num_buckets = num_buckets_;
+    header.generation = generation_;
+    std::vector<char> padded_header(tt_internal::kTTFileHeaderBytes, 0);
+    std::memcpy(padded_header.data(), &header, sizeof(header));
+    // Written to a temporary file first because the table may be mapped from
+    // `path` itself, which must not be truncated while it is mapped.
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+    fout.write(padded_header.data(), padded_header.size());
+    fout.write(reinterpret_cast<const char*>(buckets_),
+               num_buckets_ * sizeof(TTBucket));
+    fout.close();
+    if (!fout || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      std::cerr << "Error: could not write TT file " << path << std::endl;
+      std::remove(tmp_path.c_str());
+      return false;
+    }
+    return true;
   }
-  ~TranspositionTable() { delete entries; }
 
-  // returns the index in `entries` where `sit` should go.
-  inline std::size_t Location(const Situation<R, C>& sit) {
-    return SituationHash<R, C>(sit) % NumTTEntries<R, C>();
+  // Replaces the table with the one saved in the file at `path`, which is
+  // mapped into memory. The mapping is private: the file is read lazily as the
+  // table is probed, and later stores do not change the file. The table takes
+  // the size of the saved one. Must not be called during a search. Returns
+  // whether it succeeded; otherwise, it prints the error and the table is
+  // unchanged.
+  bool Load(const std::string& path) {
+    std::ifstream fin(path, std::ios::binary | std::ios::ate);
+    if (!fin) {
+      std::cerr << "Error: could not open TT file " << path << std::endl;
+      return false;
+    }
+    const std::size_t file_bytes = fin.tellg();
+    tt_internal::TTFileHeader header{};
+    fin.seekg(0);
+    fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!fin) {
+      std::cerr << "Error: TT file " << path << " is truncated" << std::endl;
+      return false;
+    }
+    if (!tt_internal::IsCompatibleTTFileHeader<R, C>(header, path)) {
+      return false;
+    }
+    const std::size_t table_bytes = header.num_buckets * sizeof(TTBucket);
+    if (file_bytes != tt_internal::kTTFileHeaderBytes + table_bytes) {
+      std::cerr << "Error: TT file " << path << " has size " << file_bytes
+                << " but its header implies "
+                << tt_internal::kTTFileHeaderBytes + table_bytes << std::endl;
+      return false;
+    }
+#if defined(__unix__) || defined(__APPLE__)
+    fin.close();
+    int fd = open(path.c_str(), O_RDONLY);
+    void* mapping = fd == -1 ? MAP_FAILED
+                             : mmap(nullptr, file_bytes, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE, fd, 0);
+    if (fd != -1) close(fd);
+    if (mapping == MAP_FAILED) {
+      std::cerr << "Error: could not map TT file " << path << std::endl;
+      return false;
+    }
+    ReleaseMemory();
+    memory_.allocation = mapping;
+    memory_.allocation_bytes = file_bytes;
+    memory_.memory =
+        static_cast<char*>(mapping) + tt_internal::kTTFileHeaderBytes;
+    memory_.bytes = table_bytes;
+    is_file_mapping_ = true;
+#else
+    tt_internal::TableMemory block =
+        tt_internal::TableMemoryPool::Instance().Acquire(table_bytes);
+    fin.seekg(tt_internal::kTTFileHeaderBytes);
+    fin.read(static_cast<char*>(block.memory), table_bytes);
+    if (!fin) {
+      std::cerr << "Error: could not read TT file " << path << std::endl;
+      tt_internal::TableMemoryPool::Instance().Release(block);
+      return false;
+    }
+    ReleaseMemory();
+    memory_ = block;
+#endif
+    buckets_ = static_cast<TTBucket*>(memory_.memory);
+    num_buckets_ = header.num_buckets;
+    generation_ = static_cast<uint8_t>(header.generation);
+    ResetSituations();
+    bucket_mask_ = num_buckets_ - 1;
+    return true;
   }
-  inline bool Contains(std::size_t location, const Situation<R, C>& sit) {
-    return (*entries)[location].sit == sit;
+
+  // Starts a new generation of entries. Entries from previous generations can
+  // still be read, but they are the first to be evicted, since they may be
+  // about situations that can no longer be reached.
+  inline void NewSearch() { ++generation_; }
+
+  inline long long NumBuckets() const { return num_buckets_; }
+  inline long long NumEntries() const { return num_buckets_ * kTTBucketSize; }
+
+  // Returns the index in `buckets_` where the situation with hash `hash`
+  // should go.
+  inline std::size_t Location(uint64_t hash) const {
+    return hash & bucket_mask_;
+  }
+
+  // Hints the CPU to start loading the bucket of `hash` into the cache, so
+  // that a later `Probe` or `Store` does not stall on a memory access.
+  inline void Prefetch(uint64_t hash) const {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(&buckets_[Location(hash)]);
+#else
+    (void)hash;
+#endif
+  }
+
+  // Returns whether the situation with hash `hash` is in the TT (up to
+  // collisions), in which case its entry is copied to `entry`. Safe to call
+  // concurrently with `Store`. With `kTTVerifyHits`, if `sit` is not null, a
+  // hit is checked against the situation stored with the entry.
+  bool Probe(uint64_t hash, TTEntry& entry,
+             const Situation<R, C>* sit = nullptr) const {
+    const std::size_t location = Location(hash);
+    const TTBucket& bucket = buckets_[location];
+    const uint32_t key = VerificationKey(hash);
+    for (int i = 0; i < kTTBucketSize; ++i) {
+      TTEntry bucket_entry = tt_internal::LoadEntry(bucket.slots[i]);
+      if (bucket_entry.alpha_beta_flag != kEmptyEntry &&
+          bucket_entry.key == key) {
+        entry = bucket_entry;
+        if (kTTVerifyHits && sit != nullptr && !situations_.empty()) {
+          VerifyHit(location * kTTBucketSize + i, *sit);
+        }
+        return true;
+      }
+    }
+    return false;
   }
-  inline bool IsEmpty(std::size_t location) {
-    return (*entries)[location].alpha_beta_flag == kEmptyEntry;
+
+  // Estimates the contents of the TT from its first `sample_buckets` buckets.
+  // Since hashes are uniformly distributed, any buckets are a fair sample.
+  TTStats SampleStats(long long sample_buckets = kTTStatsSampleBuckets) const {
+    TTStats stats;
+    sample_buckets = std::min(sample_buckets, num_buckets_);
+    stats.sampled_entries = sample_buckets * kTTBucketSize;
+    long long non_empty = 0, stale = 0;
+    std::array<long long, kMaxDepth + 1> by_depth = {};
+    for (long long i = 0; i < sample_buckets; ++i) {
+      for (const TTSlot& slot : buckets_[i].slots) {
+        TTEntry entry = tt_internal::LoadEntry(slot);
+        if (entry.alpha_beta_flag == kEmptyEntry) continue;
+        ++non_empty;
+        if (entry.generation != generation_) ++stale;
+        ++by_depth[std::clamp(static_cast<int>(entry.depth), 0, kMaxDepth)];
+      }
+    }
+    auto permille = [&stats](long long count) {
+      return count * 1000 / stats.sampled_entries;
+    };
+    stats.hashfull_permille = permille(non_empty);
+    stats.stale_permille = permille(stale);
+    for (int depth = 0; depth <= kMaxDepth; ++depth) {
+      stats.depth_permille[depth] = permille(by_depth[depth]);
+    }
+    return stats;
   }
 
-  // `location` should equal Location(sit).
-  inline void Insert(std::size_t location, const Situation<R, C>& sit,
-                     int8_t alpha_beta_flag, int8_t depth, int16_t eval,
-                     Move best_move) {
-    TTEntry<R, C>& entry = (*entries)[location];
-    entry.sit = sit;
+  // Stores an entry for the situation with hash `hash`. If the situation is
+  // already in its bucket, its entry is updated. Otherwise, it goes to an
+  // empty depth-preferred entry, if any, or it evicts the least valuable
+  // depth-preferred entry if it is not more valuable than the new one. If it
+  // does not, it goes to the replace-always entry. Returns how the entry was
+  // written. Safe to call concurrently with `Probe` and `Store`: if two
+  // threads write to the same bucket at once, one of the writes may be lost.
+  // With `kTTVerifyHits`, `sit` is stored with the entry, if it is not null.
+  TTWrites Store(uint64_t hash, int8_t alpha_beta_flag, int8_t depth,
+                 int16_t eval, Move best_move,
+                 const Situation<R, C>* sit = nullptr) {
+    TTBucket& bucket = buckets_[Location(hash)];
+    const uint32_t key = VerificationKey(hash);
+    std::array<TTEntry, kTTBucketSize> entries;
+    for (int i = 0; i < kTTBucketSize; ++i) {
+      entries[i] = tt_internal::LoadEntry(bucket.slots[i]);
+    }
+    TTWrites write_type = UPDATE_WRITE;
+    int target = -1;
+    for (int i = 0; i < kTTBucketSize; ++i) {
+      if (entries[i].alpha_beta_flag != kEmptyEntry && entries[i].key == key) {
+        target = i;
+        break;
+      }
+    }
+    if (target == -1) {
+      // The depth-preferred entry that is cheapest to lose.
+      int cheapest = 0;
+      for (int i = 0; i < kTTReplaceAlwaysIndex; ++i) {
+        if (entries[i].alpha_beta_flag == kEmptyEntry) {
+          cheapest = i;
+          break;
+        }
+        if (ReplacementValue(entries[i]) <
+            ReplacementValue(entries[cheapest])) {
+          cheapest = i;
+        }
+      }
+      target = (entries[cheapest].alpha_beta_flag == kEmptyEntry ||
+                ReplacementValue(entries[cheapest]) <= depth)
+                   ? cheapest
+                   : kTTReplaceAlwaysIndex;
+      if (entries[target].alpha_beta_flag == kEmptyEntry) {
+        write_type = ADD_WRITE;
+      } else {
+        write_type = REPLACE_WRITE;
+        METRIC_INC(tt_evictions[entries[target].depth]);
+      }
+    }
+    // Value-initialized so that the padding bytes, which are part of the
+    // stored words, are deterministic.
+    TTEntry entry{};
+    entry.key = key;
     entry.alpha_beta_flag = alpha_beta_flag;
     entry.depth = depth;
     entry.eval = eval;
-    entry.best_move = best_move;
+    entry.generation = generation_;
+    entry.SetBestMove(best_move);
+    tt_internal::StoreEntry(bucket.slots[target], entry);
+    if (kTTVerifyHits && !situations_.empty()) {
+      std::size_t index = Location(hash) * kTTBucketSize + target;
+      if (sit != nullptr) {
+        situations_[index] = *sit;
+      } else {
+        situations_[index].tokens[0] = -1;
+      }
+    }
+    return write_type;
   }
 
-  inline TTEntry<R, C>& Entry(std::size_t location) {
-    return (*entries)[location];
+  // With `kTTVerifyHits`, stops verifying hits and frees the stored
+  // situations, for tables shared by several threads.
+  void StopVerifyingHits() {
+    verify_hits_ = false;
+    ResetSituations();
+  }
+
+ private:
+  friend class Tests;
+
+  // Returns the memory of the table to the pool, or unmaps it if it is mapped
+  // from a file.
+  void ReleaseMemory() {
+    if (is_file_mapping_) {
+      tt_internal::FreeTableMemory(memory_);
+    } else {
+      tt_internal::TableMemoryPool::Instance().Release(memory_);
+    }
+    is_file_mapping_ = false;
   }
+
+  // Only with `kTTVerifyHits`: counts whether the situation stored in the
+  // entry at `index` is `sit`. Entries stored without a situation, including
+  // those loaded from a file, are not checked.
+  void VerifyHit(std::size_t index, const Situation<R, C>& sit) const {
+    const Situation<R, C>& stored = situations_[index];
+    if (stored.tokens[0] == -1) return;
+    METRIC_INC(tt_verified_hits);
+    if (stored != sit) {
+      METRIC_INC(tt_verified_collisions);
+    }
+  }
+
+  // Marks every entry as stored without a situation. Does not store any
+  // situations if the table is too large, or if it does not verify hits.
+  void ResetSituations() {
+    if (!kTTVerifyHits) return;
+    if (!verify_hits_ || NumEntries() > kTTVerifyHitsMaxEntries) {
+      std::vector<Situation<R, C>>().swap(situations_);
+      return;
+    }
+    situations_.assign(NumEntries(), Situation<R, C>());
+    for (Situation<R, C>& sit : situations_) sit.tokens[0] = -1;
+  }
+
+  // How much an entry is worth keeping: its depth, minus `kTTAgePenalty` for
+  // each search since it was stored.
+  inline int ReplacementValue(const TTEntry& entry) const {
+    uint8_t age = static_cast<uint8_t>(generation_ - entry.generation);
+    return entry.depth - kTTAgePenalty * age;
+  }
+
+  TTBucket* buckets_;
+  long long num_buckets_;
+  uint64_t bucket_mask_;
+  uint8_t generation_ = 0;
+
+  // Only with `kTTVerifyHits`: the situation of each entry, or a situation
+  // with token -1 if unknown. Empty if hits are not verified.
+  std::vector<Situation<R, C>> situations_;
+  bool verify_hits_ = true;
+
+  // The memory block that contains `buckets_`.
+  tt_internal::TableMemory memory_;
+  // Whether `memory_` is a mapping of a TT file (see `Load`) rather than a
+  // block from the pool.
+  bool is_file_mapping_ = false;
 };
 
 }  // namespace wallwars
 
-#endif  // TRANSPOSITION_TABLE_H_
\ No newline at end of file
+#endif  // TRANSPOSITION_TABLE_H_
@@ -0,0 +1,60 @@
+#ifndef ZOBRIST_H_
+#define ZOBRIST_H_
+
+#include <array>
+#include <cstdint>
+
+#include "constants.h"
+#include "graph.h"
+
+namespace wallwars {
+
+// Zobrist hashing: every component of a situation that can change during the
+// game (each wall, each player's token position, and the turn) gets a random
+// 64-bit key, and the hash of a situation is the XOR of the keys of its
+// components. Since XOR is its own inverse, applying or undoing a move only
+// needs to XOR the keys of the components that changed.
+
+// SplitMix64 pseudo-random generator. Advances `state` and returns the next
+// value. It is constexpr so that the keys can be computed at compile time.
+constexpr uint64_t SplitMix64(uint64_t& state) {
+  state += 0x9E3779B97F4A7C15ULL;
+  uint64_t z = state;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+template <int R, int C>
+struct ZobristKeys {
+  // Key XORed in when an edge is deactivated (a wall is built). Fake edges,
+  // which are always inactive, are not part of the hash and have key 0.
+  std::array<uint64_t, NumRealAndFakeEdges(R, C)> edges;
+  // Key XORed in for the node where each player's token is.
+  std::array<std::array<uint64_t, NumNodes(R, C)>, 2> tokens;
+  // Key XORed in when it is P1's turn.
+  uint64_t turn;
+};
+
+template <int R, int C>
+constexpr ZobristKeys<R, C> MakeZobristKeys(uint64_t seed) {
+  ZobristKeys<R, C> keys{};
+  uint64_t state = seed;
+  for (int edge = 0; edge < NumRealAndFakeEdges(R, C); ++edge) {
+    keys.edges[edge] = IsRealEdge(R, C, edge) ? SplitMix64(state) : 0;
+  }
+  for (int player = 0; player < 2; ++player) {
+    for (int node = 0; node < NumNodes(R, C); ++node) {
+      keys.tokens[player][node] = SplitMix64(state);
+    }
+  }
+  keys.turn = SplitMix64(state);
+  return keys;
+}
+
+template <int R, int C>
+constexpr ZobristKeys<R, C> kZobristKeys = MakeZobristKeys<R, C>(kZobristSeed);
+
+}  // namespace wallwars
+
+#endif  // ZOBRIST_H_
@@ -1,21 +1,138 @@
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <vector>
 
 #include "benchmark.h"
 #include "interactive_game.h"
+#include "negamax.h"
 #include "tests.h"
 
+// Parses a flag of the form "--name=value" into `options`. Returns false if
+// `arg` is not a known flag.
+bool ParseFlag(const std::string& arg, wallwars::NegamaxOptions& options) {
+  std::size_t eq_index = arg.find('=');
+  if (arg.rfind("--", 0) != 0 || eq_index == std::string::npos) return false;
+  std::string name = arg.substr(2, eq_index - 2);
+  std::string value = arg.substr(eq_index + 1);
+  try {
+    if (name == "tt_mb") {
+      options.tt_mb = std::stoll(value);
+      return options.tt_mb > 0;
+    }
+    if (name == "tt_prefetch_distance") {
+      options.tt_prefetch_distance = std::stoi(value);
+      return options.tt_prefetch_distance >= 0;
+    }
+    if (name == "mirror_symmetry") {
+      if (value != "0" && value != "1") return false;
+      options.mirror_symmetry = value == "1";
+      return true;
+    }
+    if (name == "two_tier_tt") {
+      if (value != "0" && value != "1") return false;
+      options.two_tier_tt = value == "1";
+      return true;
+    }
+    if (name == "num_threads") {
+      options.num_threads = std::stoi(value);
+      return options.num_threads >= 1;
+    }
+    if (name == "split_points") {
+      if (value != "0" && value != "1") return false;
+      options.split_points = value == "1";
+      return true;
+    }
+    if (name == "pvs") {
+      if (value != "0" && value != "1") return false;
+      options.pvs = value == "1";
+      return true;
+    }
+    if (name == "aspiration_window") {
+      options.aspiration_window = std::stoi(value);
+      return options.aspiration_window >= 0;
+    }
+    if (name == "num_killers") {
+      options.num_killers = std::stoi(value);
+      return options.num_killers >= 0 &&
+             options.num_killers <= wallwars::kMaxKillers;
+    }
+    if (name == "history_weight") {
+      options.history_weight = std::stoi(value);
+      return options.history_weight >= 0;
+    }
+    if (name == "countermoves") {
+      if (value != "0" && value != "1") return false;
+      options.countermoves = value == "1";
+      return true;
+    }
+    if (name == "lmr_reductions") {
+      // A comma-separated list, possibly empty.
+      options.lmr_reductions.clear();
+      std::size_t start = 0;
+      while (start < value.size()) {
+        std::size_t end = value.find(',', start);
+        if (end == std::string::npos) end = value.size();
+        int reduction = std::stoi(value.substr(start, end - start));
+        if (reduction < 0) return false;
+        options.lmr_reductions.push_back(reduction);
+        start = end + 1;
+      }
+      return true;
+    }
+    if (name == "lmr_min_moves") {
+      options.lmr_min_moves = std::stoi(value);
+      return options.lmr_min_moves >= 1;
+    }
+    if (name == "lmr_score_threshold") {
+      options.lmr_score_threshold = std::stoi(value);
+      return true;
+    }
+    if (name == "tt_file") {
+      options.tt_file = value;
+      return !value.empty();
+    }
+  } catch (const std::exception& e) {
+    return false;
+  }
+  return false;
+}
+
 int main(int argc, char* argv[]) {
-  if (argc > 1) {
-    std::string menu_option = argv[1];
+  // Flags can appear anywhere. The remaining arguments are positional.
+  wallwars::NegamaxOptions options;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.rfind("--", 0) == 0) {
+      if (!ParseFlag(arg, options)) {
+        std::cout << "Invalid flag: " << arg << std::endl;
+        return EXIT_FAILURE;
+      }
+    } else {
+      args.push_back(arg);
+    }
+  }
+
+  if (!args.empty()) {
+    std::string menu_option = args[0];
     if (menu_option == "play") {
-      wallwars::InteractiveGame::PlayGame();
+      wallwars::InteractiveGame::PlayGame(options);
+    } else if (menu_option == "analyze") {
+      int seconds = args.size() > 1 ? std::atoi(args[1].c_str()) : 0;
+      if (seconds <= 0) {
+        std::cout << "Usage: analyze <seconds> --tt_file=path" << std::endl;
+        return EXIT_FAILURE;
+      }
+      wallwars::InteractiveGame::AnalyzeStartingSituation(options,
+                                                          seconds * 1000);
     } else if (menu_option == "test") {
       wallwars::Tests::RunTests();
     } else if (menu_option == "benchmark") {
       std::string comparison_file = "";
-      if (argc > 2) comparison_file = argv[2];
-      wallwars::RunBenchmark("placeholder-for-description", comparison_file);
+      if (args.size() > 1) comparison_file = args[1];
+      wallwars::RunBenchmark("placeholder-for-description", comparison_file,
+                             options);
     } else {
       std::cout << "Unknown option: " << menu_option << std::endl;
     }
@@ -32,13 +149,13 @@ int main(int argc, char* argv[]) {
     std::cin >> menu_option;
     switch (menu_option) {
       case '1':
-        wallwars::InteractiveGame::PlayGame();
+        wallwars::InteractiveGame::PlayGame(options);
         break;
       case '2':
         wallwars::Tests::RunTests();
         break;
       case '3': {
-        wallwars::RunBenchmark("placeholder-for-description", "");
+        wallwars::RunBenchmark("placeholder-for-description", "", options);
         return 0;
       }
       default: